@@ -0,0 +1,39 @@
+#!/bin/bash
+# bench_rwf.sh [input [size]]
+#
+# Compares read times of dd_rescue per block size for buffered
+# reads (from the page cache, with and without -8 nowait) and for
+# O_DIRECT reads (with and without -8 hipri polling). Without
+# input, a temporary file is created; pass an NVMe device to see
+# the effect of polling (needs poll queues, nvme.poll_queues=N).
+#
+
+IN=${1:-bench_rwf.in}
+SZ=${2:-64M}
+BSZ="512 4k 64k 1M"
+
+if test -z "$1"; then
+	./dd_rescue -qt -Z 0 -m $SZ $IN || exit 1
+fi
+
+# Prints MB/s for reading SZ from IN with block size $1 and opts $2...
+rate()
+{
+	BS=$1; shift
+	T0=$(date +%s%N)
+	./dd_rescue -q -m $SZ -b $BS -B $BS "$@" $IN /dev/null 2>/dev/null || { echo "  n/a"; return; }
+	T1=$(date +%s%N)
+	echo "$T0 $T1 $SZ" | awk '{ s = $3; m = 1;
+		if (s ~ /[kK]$/) m = 1024; else if (s ~ /M$/) m = 1048576; else if (s ~ /G$/) m = 1073741824;
+		sub(/[kKMG]$/, "", s); printf("%7.1f", s*m/(($2-$1)/1000.0)); }'
+}
+
+printf "%6s %10s %10s %10s %10s  (MB/s)\n" bs buffered nowait direct hipri
+for bs in $BSZ; do
+	# Warm the page cache for the buffered runs (just the part we read)
+	./dd_rescue -q -n -m $SZ $IN /dev/null 2>/dev/null
+	printf "%6s %10s %10s %10s %10s\n" $bs "$(rate $bs -n)" "$(rate $bs -n -8 nowait)" \
+		"$(rate $bs -d)" "$(rate $bs -d -8 hipri)"
+done
+
+if test -z "$1"; then rm -f $IN; fi
@@ -109,6 +109,8 @@
 #include <limits.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <setjmp.h>
 #include <assert.h>
 
 #include "random.h"
@@ -118,6 +120,11 @@
 #include "find_nonzero.h"
 
 #include "fstrim.h"
+#include "uring.h"
+#include "rescuemap.h"
+#include "latmap.h"
+#include "sgio.h"
+#include "fiemap.h"
 
 #include "ddr_plugin.h"
 #include "ddr_ctrl.h"
@@ -131,6 +138,11 @@
 #include <sched.h>
 #endif
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#include <pthread.h>
+#define USE_PTHREAD 1
+#endif
+
 #ifdef HAVE_LIBGEN_H
 #include <libgen.h>
 #endif
@@ -159,6 +171,10 @@ void* libfalloc = (void*)0;
 #if defined(__linux__) && (!defined(HAVE_SPLICE) || defined(SPLICE_IS_BUGGY) || defined(TEST_SYSCALL))
 #include "splice.h"
 #endif
+/* kernel offload copy: reflink (FICLONERANGE) and copy_file_range */
+#if defined(FICLONERANGE) || defined(HAVE_COPY_FILE_RANGE)
+# define HAVE_OFFLOAD 1
+#endif
 /* fallocate64 */
 #if defined(__linux__) && (!defined(HAVE_FALLOCATE64) || defined(TEST_SYSCALL))
 # include "fallocate64.h"
@@ -200,7 +216,22 @@ void* libfalloc = (void*)0;
 #include "pread64.h"
 #endif
 
+/* ioprio_set has no glibc wrapper */
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+#define IOPRIO_CLASS_SHIFT 13
+
+/* preadv2/pwritev2 flags: polled I/O, non-blocking page cache reads */
+#if defined(HAVE_PREADV2) && defined(HAVE_PWRITEV2)
+# include <sys/uio.h>
+# if defined(RWF_HIPRI) && defined(RWF_NOWAIT)
+#  define HAVE_RWF 1
+# endif
+#endif
+
 #define MIN(a,b) ((a)<(b)? (a): (b))
+#define MAX(a,b) ((a)>(b)? (a): (b))
 
 #if __WORDSIZE == 64
 # define LL "l"
@@ -223,6 +254,7 @@ void* libfalloc = (void*)0;
 
 /* fwd decls */
 int cleanup(char);
+unsigned char* zalloc_aligned_buf(unsigned int bs, unsigned char**obuf);
 
 struct emerg_ptrs {
 	opt_t *opts;
@@ -268,6 +300,7 @@ typedef struct _ofile {
 	const char* name;
 	int fd;
 	char cdev;
+	unsigned int dioal;
 } ofile_t;
 LISTDECL(ofile_t);
 LISTTYPE(ofile_t) *ofiles;
@@ -279,11 +312,134 @@ LISTTYPE(charp) *freenames;
 typedef struct _fault_in {
 	loff_t off, off2;
 	int rep;
+	int delay;	/* ms, for slow reads */
 } fault_in_t;
 
 LISTDECL(fault_in_t);
 LISTTYPE(fault_in_t) *read_faults;
 LISTTYPE(fault_in_t) *write_faults;
+LISTTYPE(fault_in_t) *slow_faults;
+
+#ifdef USE_PTHREAD
+/* Parallel copy (-j): Each worker copies chunks from its range
+ * [cur,end[ with its own (shadow) opts, state and progress;
+ * cend is the end of the chunk it works on (or did last) */
+typedef struct _worker {
+	pthread_t thread;
+	opt_t op;
+	fstate_t fst;
+	progress_t prg;
+	repeat_t rep;
+	loff_t cur, end, cend;
+	int errs;
+	char done;
+	struct _jobs *jobs;
+} worker_t;
+
+typedef struct _jobs {
+	worker_t *wk;
+	unsigned int nwk;
+	loff_t chunk, odiff, eofpos;
+	dpopt_t *dop;
+	dpstate_t *dst;
+	char stop;
+	pthread_mutex_t mutex;
+	/* Bad blocks found by the workers, sorted and logged at the end */
+	loff_t *bbs;
+	unsigned int nbbs, allocbbs;
+} jobs_t;
+
+static jobs_t *jobs;
+
+/* Secondary outputs (-Y): Each one has a writer thread with a bounded
+ * queue of blocks; the block buffers are shared and refcounted */
+typedef struct _owbuf {
+	struct _owbuf *next;
+	unsigned char *buf, *origbuf;
+	unsigned int cap, len;
+	loff_t pos;
+	int refs;
+} owbuf_t;
+
+typedef struct _owriter {
+	pthread_t thread;
+	ofile_t *of;
+	opt_t op;
+	fstate_t fst;
+	progress_t prg;
+	owbuf_t **q;
+	unsigned int head, n;
+	pthread_cond_t cond;
+	loff_t written;
+	int errs;
+	struct timeval start, end;
+} owriter_t;
+
+typedef struct _owriters {
+	owriter_t *wr;
+	unsigned int nwr, qlen, bs;
+	char eof, abort;
+	/* Unused buffers */
+	owbuf_t *pool;
+	pthread_mutex_t mutex;
+} owriters_t;
+
+static owriters_t *owrs;
+/* Bytes that may be queued per secondary output */
+#define OWR_QBYTES (32*1024*1024)
+/* in_fault_list() modifies the lists, plugins are not reentrant */
+static pthread_mutex_t fault_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t plug_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t rmap_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Workers share the output fd, so don't let them race on its O_DIRECT flag */
+static pthread_mutex_t dio_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Workers and reader threads draw from the same rate buckets */
+static pthread_mutex_t rate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t lat_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Map file (-O): State of input regions, saved regularly and on exit */
+static rmap_t *rmap;
+#define RMAP_SAVEINTV 30
+
+/* Latency file (-5): Histograms and read latency per input region,
+ * written on exit and on SIGUSR1 */
+static latmap_t *latmap;
+static char lat_hdr[256];
+static volatile sig_atomic_t lat_dumpreq;
+#define LAT_MINREG (1024*1024)
+#define LAT_MAXREGS 65536
+
+/* Write combining (hardbs crawl): Contiguous writes to the main output,
+ * collected in buf[start,start+len[ for output position pos, which
+ * corresponds to input position pos+ioff */
+typedef struct _wcomb {
+	unsigned char *buf, *origbuf;
+	unsigned int cap, start, len;
+	loff_t pos, ioff;
+	int errs;
+	char active, fatal;
+	opt_t *op;
+	fstate_t *fst;
+	progress_t *prg;
+	dpopt_t *dop;
+} wcomb_t;
+static wcomb_t wcomb;
+static void wcomb_flush();
+static int wcomb_stop();
+static char wcomb_add(const unsigned char *bf, size_t sz, loff_t off);
+static int is_writeerr_fatal(int err, opt_t *op);
+
+/* -8: RWF_HIPRI polls for completion of O_DIRECT I/O (needs poll queues,
+ * e.g. nvme.poll_queues), RWF_NOWAIT serves buffered reads from the
+ * page cache without blocking, falling back to normal reads for misses */
+#define RWF_MODE_NOWAIT 1
+#define RWF_MODE_HIPRI 2
+#ifdef HAVE_RWF
+static char rwf_mode;
+/* Bytes asked for and served from the page cache with RWF_NOWAIT */
+static unsigned long long rwf_tried, rwf_cached;
+#endif
 
 const char *scrollup = 0;
 
@@ -745,7 +901,9 @@ static inline void fadvise(char after, opt_t *op, fstate_t *fst, progress_t *prg
 			posix_fadvise64(fst->ides, op->init_ipos, prg->xfer, POSIX_FADV_NOREUSE);
 		else 
 			posix_fadvise64(fst->ides, op->init_ipos, fst->estxfer, POSIX_FADV_SEQUENTIAL);
-	}
+	} else if (!after && op->revahead)
+		/* Forward readahead would only fetch what we have read already */
+		posix_fadvise64(fst->ides, 0, 0, POSIX_FADV_RANDOM);
 }
 #else
 static inline void fadvise(char after, opt_t *op, fstate_t *fst, progress_t *prg)
@@ -833,7 +991,8 @@ void updgraph(int err, fstate_t *fst, dpopt_t *dop, opt_t *op)
 {
 	if (!graph)
 		return;
-	const loff_t base = op->reverse? fst->fin_ipos: op->init_ipos;
+	/* multipass (-N) only temporarily goes backwards */
+	const loff_t base = (op->reverse && !op->multipass)? fst->fin_ipos: op->init_ipos;
 	loff_t relpos = fst->ipos - base;
 	if (relpos < 0) {
 		graph[0] = '!';
@@ -907,7 +1066,7 @@ void input_length(opt_t *op, fstate_t *fst)
 {
 	char iblk = 0;
 	loff_t ilen, olen, ofree = 0;
-	ilen = file_len(fst->ides, &fst->i_chr, &iblk, op->iname, op->sparse);
+	ilen = file_len(fst->ides, &fst->i_chr, &iblk, op->iname, op->sparse || op->extents);
 	olen = file_len(fst->odes, &fst->o_chr, &fst->o_blk, op->oname, 1);
 	/* If we have a valid len already, things are easy ... */
 	if (ilen) {
@@ -1026,6 +1185,16 @@ int output_length(opt_t *op, fstate_t *fst)
 }
 
 
+/* Can sparse mode zero the old output contents it skips (see zrun_t)? */
+static int can_zero_skipped(opt_t *op)
+{
+#if (defined(HAVE_FALLOCATE64) && defined(FALLOC_FL_PUNCH_HOLE)) || defined(BLKZEROOUT)
+	return op->sparse && !plugins_loaded;
+#else
+	return 0;
+#endif
+}
+
 static void sparse_output_warn(opt_t *op, fstate_t *fst)
 {
 	struct STAT64 stbuf;
@@ -1039,12 +1208,14 @@ static void sparse_output_warn(opt_t *op, fstate_t *fst)
 		return;
 	}
 	if (S_ISBLK(stbuf.st_mode)) {
-		if (op->sparse || !op->nosparse)
+		if (op->sparse && can_zero_skipped(op))
+			fplog(stderr, INFO, "%s is a block device; skipped blocks will be zeroed\n", op->oname);
+		else if (op->sparse || !op->nosparse)
 			fplog(stderr, WARN, "%s is a block device; -a not recommended; -A recommended\n", op->oname);
 		return;
 	}
 	eff_opos = (op->init_opos == (loff_t)-INT_MAX? op->init_ipos: op->init_opos);
-	if (op->sparse && (eff_opos < stbuf.st_size))
+	if (op->sparse && (eff_opos < stbuf.st_size) && !can_zero_skipped(op))
 		fplog(stderr, WARN, "write into %s (@%sk/%sk): sparse not recommended\n", 
 				op->oname, fmt_kiB(eff_opos, !nocol), fmt_kiB(stbuf.st_size, !nocol));
 }
@@ -1159,6 +1330,78 @@ void doprint(FILE* const file, const unsigned int bs, const clock_t cl,
 		scrollup = threeup;
 }
 
+#ifdef HAVE_SYNC_FILE_RANGE
+/* Write-behind for -y: Start writeback of what has been written since
+ * the last call, but only wait for the window before and drop it from
+ * the page cache, so dirty memory stays bounded without the stall of
+ * a full fsync */
+static int sync_behind(opt_t *op, fstate_t *fst)
+{
+	static loff_t lastpos = -1, prevbeg, prevend;
+	static char nowb;
+	if (nowb)
+		return fsync(fst->odes);
+	if (lastpos < 0)
+		lastpos = op->init_opos;
+	const loff_t beg = MIN(lastpos, fst->opos), end = MAX(lastpos, fst->opos);
+	lastpos = fst->opos;
+	if (end > beg && sync_file_range(fst->odes, beg, end-beg, SYNC_FILE_RANGE_WRITE)) {
+		/* Not supported here (e.g. pipe), use fsync */
+		nowb = 1;
+		return fsync(fst->odes);
+	}
+	if (prevend > prevbeg) {
+		if (sync_file_range(fst->odes, prevbeg, prevend-prevbeg, SYNC_FILE_RANGE_WAIT_BEFORE
+				    | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER))
+			return -1;
+#ifdef HAVE_POSIX_FADVISE
+		posix_fadvise64(fst->odes, prevbeg, prevend-prevbeg, POSIX_FADV_DONTNEED);
+#endif
+	}
+	prevbeg = beg; prevend = end;
+	return 0;
+}
+#else
+# define sync_behind(op, fst) fsync(fst->odes)
+#endif
+
+#ifdef HAVE_POSIX_FADVISE
+/* Rolling eviction (-0): Once the copy has moved op->evict bytes on,
+ * drop the input pages behind it from the page cache; for the output,
+ * start writeback of the window and drop the window before (after
+ * waiting for its writeback), as dirty pages can't be dropped.
+ * Otherwise, copying a large disk pushes everything else out. */
+static void evict_behind(opt_t *op, fstate_t *fst)
+{
+	static loff_t ilast = -1, olast, prevbeg, prevend;
+	if (ilast < 0) {
+		ilast = op->init_ipos;
+		olast = op->init_opos;
+	}
+	const loff_t ibeg = MIN(ilast, fst->ipos), iend = MAX(ilast, fst->ipos);
+	if (iend - ibeg < op->evict)
+		return;
+	ilast = fst->ipos;
+	if (!fst->i_chr && !fst->dio_ialign)
+		posix_fadvise64(fst->ides, ibeg, iend-ibeg, POSIX_FADV_DONTNEED);
+	if (fst->o_chr || fst->dio_oalign)
+		return;
+	const loff_t beg = MIN(olast, fst->opos), end = MAX(olast, fst->opos);
+	olast = fst->opos;
+	/* Collected hardbs writes belong to this window */
+	wcomb_flush();
+#ifdef HAVE_SYNC_FILE_RANGE
+	sync_file_range(fst->odes, beg, end-beg, SYNC_FILE_RANGE_WRITE);
+	if (prevend > prevbeg)
+		sync_file_range(fst->odes, prevbeg, prevend-prevbeg, SYNC_FILE_RANGE_WAIT_BEFORE
+				| SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+	if (prevend > prevbeg)
+		posix_fadvise64(fst->odes, prevbeg, prevend-prevbeg, POSIX_FADV_DONTNEED);
+	prevbeg = beg; prevend = end;
+}
+#endif
+
 void printstatus(FILE* const file1, FILE* const file2,
 		 const int bs, const int sync,
 		 opt_t *op, fstate_t *fst, progress_t *prg,
@@ -1168,8 +1411,12 @@ void printstatus(FILE* const file1, FILE* const file2,
 	clock_t cl;
 	static int einvalwarn = 0;
 
+	/* -j: The main thread reports the aggregated status */
+	if (op->worker)
+		return;
 	if (sync) {
-		int err = fsync(fst->odes);
+		wcomb_flush();
+		int err = sync_behind(op, fst);
 		if (err && (errno != EINVAL || !einvalwarn) &&!fst->o_chr) {
 			fplog(stderr, WARN, "sync %s (%sskiB): %s!  \n",
 			      op->oname, fmt_kiB(fst->ipos, !nocol), strerror(errno));
@@ -1189,54 +1436,6 @@ void printstatus(FILE* const file1, FILE* const file2,
 	if (t2 == 0.0)
 		t2 = 0.0001;
 #endif
-	if (op->maxkbs && t1 && t2) {
-		static unsigned w1 =0, w2 = 0, w3 = 0;
-		static float t1w = 0.0, t2w = 0.0;
-		/* Avoid global rate above limit */
-		float c1rate = prg->xfer/(1024.0*t1);
-		/* Avoid local rate above twice the limit */
-		float c2rate = (prg->xfer-prg->lxfer)/(2048.0*t2);
-		if (!in_report && (c1rate > op->maxkbs || c2rate > op->maxkbs)) {
-			struct timeval wtime;
-			memcpy(&wtime, &currenttime, sizeof(wtime));
-			int m1sleep = 3*prg->xfer/(2*op->maxkbs) - t1*1536.0;
-			int m2sleep = (prg->xfer-prg->lxfer)/(2*op->maxkbs) - t2*1024.0;
-			int mssleep;
-			if (m2sleep >= m1sleep) {
-			       	++w3;
-				mssleep = m2sleep;
-			} else
-				mssleep = m1sleep;
-			/* Do not pause longer than 8.2s */
-			if (mssleep > 8192)
-				mssleep = 8192;
-			//fprintf(stderr, "%04ims\r", mssleep); fflush(stderr);
-			cpu_relax();
-			if (mssleep >= 2) {
-				struct timespec ts;
-				++w1;
-				if (op->verbose && scrollup)
-					fprintf(stderr, "%s.\n", up);
-				ts.tv_sec = mssleep / 1000;
-				ts.tv_nsec = 1000*1000ULL*(mssleep%1000);
-				nanosleep(&ts, NULL);
-				gettimeofday(&currenttime, NULL);
-				t1w += difftimetv(&currenttime, &wtime);
-			} else {
-				++w2;
-				sched_yield();
-				gettimeofday(&currenttime, NULL);
-				t2w += difftimetv(&currenttime, &wtime);
-			}
-			t1 = difftimetv(&currenttime, &starttime);
-			t2 = difftimetv(&currenttime, &lasttime);
-			cl = clock();
-		}
-		if (in_report && op->verbose)
-			fplog(stderr, INFO, "Sleep stats: %i(%.4f), %i(%.6f) - %i\n",
-					w1, w1? t1w/w1: 0.0,
-					w2, w2? t2w/w2: 0.0, w3);
-	}
 	/* Idea: Could save last not printed status and print on err */
 	if (t2 < printint && !sync && !in_report) {
 		/* We need to update more than 10x per second if copy time
@@ -1263,11 +1462,95 @@ void printstatus(FILE* const file1, FILE* const file2,
 	}
 }
 
-static void savebb(loff_t block, opt_t *op)
+static void lat_save()
+{
+	const int err = latmap_save(latmap, lat_hdr);
+	if (err)
+		fplog(stderr, WARN, "saving latency file %s: %s!\n", latmap->name, strerror(-err));
+}
+
+static unsigned int lat_us(const struct timespec *t0)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t0->tv_sec)*1000000 + (now.tv_nsec - t0->tv_nsec)/1000;
+}
+
+/* Account I/O started at t0; reads (wr == 0) at input pos off */
+static void lat_record(const struct timespec *t0, char wr, loff_t off, char err)
+{
+	const unsigned int us = lat_us(t0);
+	/* Callers check errno of the I/O after this */
+	const int eno = errno;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&lat_mutex);
+#endif
+	if (wr)
+		latmap_write(latmap, us);
+	else
+		latmap_read(latmap, off, us, err);
+	if (lat_dumpreq) {
+		lat_dumpreq = 0;
+		lat_save();
+	}
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&lat_mutex);
+#endif
+	errno = eno;
+}
+
+static void lat_report(FILE *file, const char* nm, const lathist_t *hist)
+{
+	if (!hist->n)
+		return;
+	fplog(file, INFO, "%s latency: avg %llius, 50%% <%ius, 99%% <%ius, 99.9%% <%ius, max %ius\n",
+	      nm, hist->sum/hist->n, lathist_pct(hist, 50), lathist_pct(hist, 99),
+	      lathist_pct(hist, 99.9), hist->max);
+}
+
+static void rmap_checkpoint(opt_t *op)
+{
+	const int err = rmap_save(rmap);
+	if (err)
+		fplog(stderr, WARN, "saving map file %s: %s!\n", op->mapname, strerror(-err));
+}
+
+static void zrun_checkpoint();
+
+/* Record state of input range [pos,pos+len[ in the map file */
+static void mapmark(loff_t pos, loff_t len, char state, opt_t *op)
+{
+	if (!rmap || len <= 0)
+		return;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&rmap_mutex);
+#endif
+	rmap_mark(rmap, pos, len, state);
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&rmap_mutex);
+#endif
+	if (time(NULL) - rmap->lastsave < RMAP_SAVEINTV)
+		return;
+	/* Don't save data as good that is not written (or zeroed) yet;
+	 * failures mark their range again, so not under rmap_mutex.
+	 * Zeroes may be written via the combine buffer, so that's last */
+	if (!op->worker) {
+		zrun_checkpoint();
+		wcomb_flush();
+	}
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&rmap_mutex);
+#endif
+	if (time(NULL) - rmap->lastsave >= RMAP_SAVEINTV)
+		rmap_checkpoint(op);
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&rmap_mutex);
+#endif
+}
+
+static void writebb(loff_t block, opt_t *op)
 {
 	FILE *bbfile;
-	fplog(stderr, WARN, "Bad block reading %s: %s \n", 
-			op->iname, fmt_int(0, 0, 1, block, (nocol? "": BOLD), (nocol? "": NORM), 1));
 	if (op->bbname == NULL)
 		return;
 	bbfile = fopen(op->bbname, "a");
@@ -1275,6 +1558,29 @@ static void savebb(loff_t block, opt_t *op)
 	fclose(bbfile);
 }
 
+static void savebb(loff_t pos, int len, opt_t *op)
+{
+	const loff_t block = pos/op->hardbs;
+	mapmark(pos, len, RMAP_BAD, op);
+	fplog(stderr, WARN, "Bad block reading %s: %s \n", 
+			op->iname, fmt_int(0, 0, 1, block, (nocol? "": BOLD), (nocol? "": NORM), 1));
+#ifdef USE_PTHREAD
+	/* Workers collect, so the bbfile ends up sorted */
+	if (op->worker) {
+		pthread_mutex_lock(&jobs->mutex);
+		if (jobs->nbbs == jobs->allocbbs) {
+			jobs->allocbbs = jobs->allocbbs? 2*jobs->allocbbs: 64;
+			jobs->bbs = (loff_t*)realloc(jobs->bbs, jobs->allocbbs*sizeof(loff_t));
+			assert(jobs->bbs);
+		}
+		jobs->bbs[jobs->nbbs++] = block;
+		pthread_mutex_unlock(&jobs->mutex);
+		return;
+	}
+#endif
+	writebb(block, op);
+}
+
 void printreport(opt_t *op, fstate_t *fst, progress_t *prg, dpopt_t *dop)
 {
 	/* report */
@@ -1472,11 +1778,20 @@ ssize_t writeblock(int towrite, int *shouldwr, opt_t *op, fstate_t *fst,
 		   progress_t *prg, dpopt_t *dop);
 static void advancepos(const ssize_t rd, const ssize_t wr, const ssize_t rwr,
 		       opt_t *op, fstate_t *fst, progress_t *prg);
+#ifdef USE_PTHREAD
+static void owriters_eof(fstate_t *fst);
+static void owriters_close(opt_t *op);
+static void tgtpf_free();
+static void dl_release();
+#endif
+static void mm_release(fstate_t *fst);
+static void zrun_flush(opt_t *op, fstate_t *fst, progress_t *prg);
 
 int real_cleanup(opt_t *op, fstate_t *fst, progress_t *prg, 
 		 dpopt_t *dop, dpstate_t *dst, char closelog)
 {
 	int rc = 0, errs = 0;
+	errs += wcomb_stop();
 	if (!op->dosplice && !dop->bsim715) {
 		/* EOF notifiction */
 		int fbytes = writeblock(0, &rc, op, fst, prg, dop);
@@ -1487,7 +1802,20 @@ int real_cleanup(opt_t *op, fstate_t *fst, progress_t *prg,
 		/* And finalize */
 		errs += call_plugins_close(op, fst);
 	}
+	mm_release(fst);
+	zrun_flush(op, fst, prg);
+#ifdef USE_PTHREAD
+	tgtpf_free();
+	dl_release();
+	/* Secondary outputs drain their queues and fsync in parallel */
+	if (owrs)
+		owriters_eof(fst);
+#endif
 	errs += sync_close(fst->odes, op->oname, fst->o_chr, op, fst);
+#ifdef USE_PTHREAD
+	if (owrs)
+		owriters_close(op);
+#endif
 	if (fst->ides != -1) {
 		rc = close(fst->ides);
 		if (rc) {
@@ -1518,6 +1846,27 @@ int real_cleanup(opt_t *op, fstate_t *fst, progress_t *prg,
 			remove_and_trim(LISTDATA(of).name, op);
 	}
 	ZFREE(fst->origbuf);
+	ZFREE(wcomb.origbuf);
+	if (rmap) {
+		if (rmap->dirty)
+			rmap_checkpoint(op);
+		rmap_free(rmap);
+		rmap = 0;
+	}
+	if (latmap) {
+		lat_report(stderr, "read", &latmap->rd);
+		lat_report(stderr, "write", &latmap->wr);
+		lat_save();
+		latmap_free(latmap);
+		latmap = 0;
+	}
+#ifdef HAVE_RWF
+	if (rwf_tried) {
+		fplog(stderr, INFO, "%skiB of %skiB read from page cache without blocking\n",
+		      fmt_kiB(rwf_cached, !nocol), fmt_kiB(rwf_tried, !nocol));
+		rwf_tried = 0;
+	}
+#endif
 	if (dst->prng_state2) {
 		frandom_release(dst->prng_state2);
 		dst->prng_state2 = 0;
@@ -1535,6 +1884,7 @@ int real_cleanup(opt_t *op, fstate_t *fst, progress_t *prg,
 	LISTTREEDEL(freenames, charp);
 	LISTTREEDEL(read_faults, fault_in_t);
 	LISTTREEDEL(write_faults, fault_in_t);
+	LISTTREEDEL(slow_faults, fault_in_t);
 #if USE_LIBDL
 	if (libfalloc)
 		dlclose(libfalloc);
@@ -1640,6 +1990,9 @@ int in_fault_list(LISTTYPE(fault_in_t) *faults, off_t off1, off_t off2)
 		return 0;
 	int hit = 0;
 	LISTTYPE(fault_in_t) *faultiter;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&fault_mutex);
+#endif
 	LISTFOREACH(faults, faultiter) {
 		fault_in_t *fault = &LISTDATA(faultiter);
 #if 0
@@ -1660,36 +2013,504 @@ int in_fault_list(LISTTYPE(fault_in_t) *faults, off_t off1, off_t off2)
 				hit = 1+(fault->off>off1? fault->off-off1: 0);
 		}
 	}
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&fault_mutex);
+#endif
 #if 0
 	fplog(stderr, NOHDR, "%i%s\n", hit, (hit?"-1":""));
 #endif
 	return hit;
 }
 
+/* Injected read latency in ms for blocks [off1,off2[ */
+static int slow_fault_delay(off_t off1, off_t off2)
+{
+	int delay = 0;
+	LISTTYPE(fault_in_t) *faultiter;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&fault_mutex);
+#endif
+	LISTFOREACH(slow_faults, faultiter) {
+		fault_in_t *fault = &LISTDATA(faultiter);
+		if (!fault->rep || off1 >= fault->off2 || off2 <= fault->off)
+			continue;
+		if (fault->rep < 0) {
+			if (!++fault->rep)
+				fault->rep = 15;
+			continue;
+		}
+		--fault->rep;
+		delay = MAX(delay, fault->delay);
+	}
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&fault_mutex);
+#endif
+	return delay;
+}
+
+/* Rate limit (-C): Token buckets for reads and writes (in bytes, bytes/s).
+ * Tokens refill with the rate up to burst; a transfer may take the bucket
+ * into debt, the caller then sleeps until it's paid back. This keeps the
+ * rate smooth instead of the old catch-up sleeping every few blocks. */
+typedef struct _tbucket {
+	double rate, burst, tokens;
+	struct timespec last;
+} tbucket_t;
+
+static tbucket_t rd_bucket, wr_bucket;
+
+static void tbucket_init(tbucket_t *tb, unsigned int kbs, unsigned int burstkb)
+{
+	tb->rate = 1024.0*kbs;
+	tb->burst = burstkb? 1024.0*burstkb: tb->rate/8;
+	tb->tokens = tb->burst;
+	clock_gettime(CLOCK_MONOTONIC, &tb->last);
+}
+
+static void tbucket_take(tbucket_t *tb, size_t bytes)
+{
+	struct timespec now;
+	double wait;
+	if (!tb->rate || !bytes)
+		return;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&rate_mutex);
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tb->tokens += tb->rate * ((now.tv_sec - tb->last.tv_sec)
+				  + (now.tv_nsec - tb->last.tv_nsec)*1e-9);
+	if (tb->tokens > tb->burst)
+		tb->tokens = tb->burst;
+	tb->last = now;
+	tb->tokens -= bytes;
+	wait = tb->tokens < 0? -tb->tokens/tb->rate: 0;
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&rate_mutex);
+#endif
+	if (wait > 0) {
+		struct timespec ts;
+		ts.tv_sec = (time_t)wait;
+		ts.tv_nsec = (long)((wait - ts.tv_sec)*1e9);
+		while (nanosleep(&ts, &ts) && errno == EINTR && !interrupted)
+			;
+	}
+}
+
+/* Injected read fault in [off,off+sz[? Sets errno (0 at EOF) and returns 1 */
+static int read_fault(loff_t off, size_t sz, opt_t *op, fstate_t *fst)
+{
+	int fault = in_fault_list(read_faults, off/op->hardbs,
+				  (off+(loff_t)sz+(loff_t)(op->hardbs-1))/op->hardbs);
+	if (!fault)
+		return 0;
+	fplog(stderr, DEBUG, "Inject read fault @ %li (rd %iblk @ %li*%i)\n",
+		(long)((fault-1)*op->hardbs+off), (sz+op->hardbs-1)/op->hardbs,
+		off/op->hardbs, op->hardbs);
+	if (!op->reverse && fst->fin_ipos && fst->ipos == fst->fin_ipos)
+		/* EOF, we can't proceed any further */
+		errno = 0;
+	else
+		errno = EIO;
+	// Cloud read and return (fault-1)*op->hardbs bytes ...
+	return 1;
+}
+
+#ifdef HAVE_RWF
+/* Kernel or filesystem does not know the flag; don't try again */
+static char rwf_unsupp(char mode)
+{
+	if (errno != EOPNOTSUPP && errno != ENOSYS)
+		return 0;
+	if (rwf_mode & mode)
+		fplog(stderr, WARN, "%s not supported: %s\n",
+		      (mode == RWF_MODE_HIPRI? "polled I/O (RWF_HIPRI)": "RWF_NOWAIT"),
+		      strerror(errno));
+	rwf_mode &= ~mode;
+	return 1;
+}
+#endif
+
+/* Buffered pread, trying the page cache first with -8 nowait */
+static ssize_t buf_pread(int fd, unsigned char *bf, size_t sz, loff_t off)
+{
+#ifdef HAVE_RWF
+	if (rwf_mode & RWF_MODE_NOWAIT) {
+		struct iovec iov = { bf, sz };
+		ssize_t rd = preadv2(fd, &iov, 1, off, RWF_NOWAIT);
+		if (rd < 0) {
+			if (errno != EAGAIN && !rwf_unsupp(RWF_MODE_NOWAIT))
+				return rd;
+			rd = 0;
+		}
+		__atomic_fetch_add(&rwf_tried, sz, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&rwf_cached, rd, __ATOMIC_RELAXED);
+		if ((size_t)rd == sz)
+			return rd;
+		/* Miss or partial hit (or EOF): read the rest normally */
+		const ssize_t n = pread64(fd, bf+rd, sz-rd, off+rd);
+		if (n < 0)
+			return rd? rd: n;
+		return rd+n;
+	}
+#endif
+	return pread64(fd, bf, sz, off);
+}
+
+#ifdef O_DIRECT
+/* pread for the O_DIRECT bulk, polled with -8 hipri */
+static ssize_t dio_rawpread(int fd, void *bf, size_t sz, loff_t off)
+{
+#ifdef HAVE_RWF
+	if (rwf_mode & RWF_MODE_HIPRI) {
+		struct iovec iov = { bf, sz };
+		const ssize_t rd = preadv2(fd, &iov, 1, off, RWF_HIPRI);
+		if (rd >= 0 || !rwf_unsupp(RWF_MODE_HIPRI))
+			return rd;
+	}
+#endif
+	return pread64(fd, bf, sz, off);
+}
+
+static ssize_t dio_rawpwrite(int fd, void *bf, size_t sz, loff_t off)
+{
+#ifdef HAVE_RWF
+	if (rwf_mode & RWF_MODE_HIPRI) {
+		struct iovec iov = { bf, sz };
+		const ssize_t wr = pwritev2(fd, &iov, 1, off, RWF_HIPRI);
+		if (wr >= 0 || !rwf_unsupp(RWF_MODE_HIPRI))
+			return wr;
+	}
+#endif
+	return pwrite64(fd, bf, sz, off);
+}
+
+/* Largest alignment we handle, also the alignment of the bounce buffer */
+#define DIO_MAXALIGN 4096
+#define DIO_BOUNCE (64*1024)
+
+/* Determine the alignment O_DIRECT needs on fd (logical block size for
+ * block devices) and enable O_DIRECT on block devices unless o_dir is
+ * set already or auto is 0; returns the alignment or 0 if not direct */
+static unsigned int dio_setup(int fd, int o_dir, char autodio, const char *nm)
+{
+	struct STAT64 stbuf;
+	if (FSTAT64(fd, &stbuf))
+		return 0;
+	if (!o_dir && !(autodio && S_ISBLK(stbuf.st_mode)))
+		return 0;
+	unsigned int al = MIN(MAX(stbuf.st_blksize, 512), DIO_MAXALIGN);
+#ifdef BLKSSZGET
+	int ssz = 0;
+	if (S_ISBLK(stbuf.st_mode) && !ioctl(fd, BLKSSZGET, &ssz) && ssz > 0)
+		al = ssz;
+#endif
+	int flags = fcntl(fd, F_GETFL);
+	if (al > DIO_MAXALIGN) {
+		fplog(stderr, WARN, "%s: logical block size %i too large for O_DIRECT\n", nm, al);
+		if (o_dir && flags != -1)
+			fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+		return 0;
+	}
+	if (!o_dir) {
+		if (flags == -1 || fcntl(fd, F_SETFL, flags | O_DIRECT))
+			return 0;
+		fplog(stderr, INFO, "using O_DIRECT for block device %s (use -n to avoid)\n", nm);
+	}
+	return al;
+}
+
+/* O_DIRECT read: The aligned bulk goes directly into bf, unaligned heads
+ * and tails (in the file or in memory) are read via an aligned bounce buffer */
+static ssize_t dio_pread(int fd, unsigned char *bf, size_t sz, loff_t off,
+			 const unsigned int al)
+{
+	unsigned char bounce[DIO_BOUNCE] __attribute__((aligned(DIO_MAXALIGN)));
+	ssize_t rd = 0;
+	while (sz) {
+		const size_t head = off % al;
+		size_t want, got;
+		ssize_t n;
+		if (!head && !((unsigned long)bf % al) && sz >= al) {
+			want = sz - sz%al;
+			n = dio_rawpread(fd, bf, want, off);
+			got = n > 0? n: 0;
+		} else {
+			want = MIN(sz, DIO_BOUNCE-head);
+			n = dio_rawpread(fd, bounce, (head+want+al-1)/al*al, off-head);
+			got = n > (ssize_t)head? MIN(want, n-head): 0;
+			memcpy(bf, bounce+head, got);
+		}
+		if (n < 0)
+			return rd? rd: n;
+		rd += got; bf += got; off += got; sz -= got;
+		if (got < want)
+			break;
+	}
+	return rd;
+}
+
+/* pwrite with O_DIRECT temporarily turned off */
+static ssize_t nodio_pwrite(int fd, unsigned char *bf, size_t sz, loff_t off)
+{
+	ssize_t wr;
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&dio_mutex);
+#endif
+	const int flags = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+	wr = pwrite64(fd, bf, sz, off);
+	const int eno = errno;
+	fcntl(fd, F_SETFL, flags);
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&dio_mutex);
+#endif
+	errno = eno;
+	return wr;
+}
+
+/* O_DIRECT write: Aligned blocks are written directly (via the bounce
+ * buffer if bf is misaligned), partial blocks are left to the kernel,
+ * as it needs to read-modify-write them anyway */
+static ssize_t dio_pwrite(int fd, unsigned char *bf, size_t sz, loff_t off,
+			  const unsigned int al)
+{
+	unsigned char bounce[DIO_BOUNCE] __attribute__((aligned(DIO_MAXALIGN)));
+	ssize_t wr = 0;
+	while (sz) {
+		const size_t head = off % al;
+		size_t want;
+		ssize_t n;
+		if (head || sz < al) {
+			want = MIN(sz, al-head);
+			n = nodio_pwrite(fd, bf, want, off);
+		} else if ((unsigned long)bf % al) {
+			want = MIN(sz - sz%al, DIO_BOUNCE);
+			memcpy(bounce, bf, want);
+			n = dio_rawpwrite(fd, bounce, want, off);
+		} else {
+			want = sz - sz%al;
+			n = dio_rawpwrite(fd, bf, want, off);
+		}
+		if (n <= 0)
+			return wr? wr: n;
+		wr += n; bf += n; off += n; sz -= n;
+		if ((size_t)n < want)
+			break;
+	}
+	return wr;
+}
+#endif
+
+#ifndef ETIME
+# define ETIME ETIMEDOUT
+#endif
+
+/* pread from the input, taking care of O_DIRECT alignment and
+ * injected latency (delay in ms) */
+static ssize_t ipread(int fd, unsigned char *bf, size_t sz, loff_t off,
+		      unsigned int dioal, unsigned int delay)
+{
+	if (delay) {
+		struct timespec ts = { delay/1000, (delay%1000)*1000000 };
+		nanosleep(&ts, NULL);
+	}
+#ifdef O_DIRECT
+	if (dioal)
+		return dio_pread(fd, bf, sz, off, dioal);
+#endif
+	return buf_pread(fd, bf, sz, off);
+}
+
+#ifdef HAVE_SCSI_SG_H
+/* SCSI passthrough input (-7), lbsz != 0 if in use */
+static sgdev_t sgdev;
+
+/* Read via SG_IO in chunks the device accepts, logging sense data */
+static ssize_t sg_pread(int fd, unsigned char *bf, size_t sz, loff_t off, opt_t *op)
+{
+	char msg[128];
+	ssize_t rd = 0;
+	while (sz) {
+		const size_t want = MIN(sz, sgdev.maxbytes);
+		const ssize_t n = sgio_pread(fd, &sgdev, bf, want, off, op->sgio_tmo, msg, sizeof(msg));
+		if (*msg)
+			fplog(stderr, WARN, "SG_IO read %s (%skiB): %s\n",
+			      op->iname, fmt_kiB(off, !nocol), msg);
+		if (n < 0)
+			return rd? rd: n;
+		rd += n; bf += n; off += n; sz -= n;
+		if ((size_t)n < want)
+			break;
+	}
+	return rd;
+}
+#endif
+
+#ifdef USE_PTHREAD
+/* Read deadline (-6): Reads are done by helper threads into their own
+ * buffers. If a read does not complete in time, we give up waiting and
+ * report ETIME; the thread is abandoned (it exits once the kernel returns)
+ * and the next read gets a fresh one. */
+typedef struct _dlreader {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned char *buf, *origbuf;
+	size_t bufsz;
+	int fd;
+	size_t sz;
+	loff_t off;
+	unsigned int dioal, delay;
+	ssize_t res;
+	int err;
+	char busy, abandoned, quit;
+	struct _dlreader *next;
+} dlreader_t;
+
+static dlreader_t *dl_idle;
+static unsigned int dl_hung;
+static pthread_mutex_t dl_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Don't pile up more threads stuck in the kernel than this */
+#define DL_MAXHUNG 16
+
+static void* dl_thread(void *arg)
+{
+	dlreader_t *dl = (dlreader_t*)arg;
+	pthread_mutex_lock(&dl->mutex);
+	while (1) {
+		while (!dl->busy && !dl->quit)
+			pthread_cond_wait(&dl->cond, &dl->mutex);
+		if (dl->quit)
+			break;
+		pthread_mutex_unlock(&dl->mutex);
+		const ssize_t rd = ipread(dl->fd, dl->buf, dl->sz, dl->off, dl->dioal, dl->delay);
+		const int err = errno;
+		pthread_mutex_lock(&dl->mutex);
+		dl->res = rd; dl->err = err;
+		dl->busy = 0;
+		if (dl->abandoned)
+			break;
+		pthread_cond_signal(&dl->cond);
+	}
+	pthread_mutex_unlock(&dl->mutex);
+	if (dl->abandoned) {
+		pthread_mutex_lock(&dl_mutex);
+		--dl_hung;
+		pthread_mutex_unlock(&dl_mutex);
+	}
+	pthread_cond_destroy(&dl->cond);
+	pthread_mutex_destroy(&dl->mutex);
+	ZFREE(dl->origbuf);
+	free(dl);
+	return NULL;
+}
+
+static dlreader_t* dl_new()
+{
+	pthread_t tid;
+	pthread_attr_t attr;
+	dlreader_t *dl = (dlreader_t*)calloc(1, sizeof(dlreader_t));
+	if (!dl)
+		return NULL;
+	pthread_mutex_init(&dl->mutex, NULL);
+	pthread_cond_init(&dl->cond, NULL);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	const int err = pthread_create(&tid, &attr, dl_thread, dl);
+	pthread_attr_destroy(&attr);
+	if (err) {
+		pthread_cond_destroy(&dl->cond);
+		pthread_mutex_destroy(&dl->mutex);
+		free(dl);
+		return NULL;
+	}
+	return dl;
+}
+
+static ssize_t dl_pread(int fd, unsigned char *bf, size_t sz, loff_t off,
+			unsigned int dioal, unsigned int delay, unsigned int deadline)
+{
+	static char hungwarn;
+	dlreader_t *dl;
+	struct timespec ts;
+	int rc = 0;
+	pthread_mutex_lock(&dl_mutex);
+	dl = dl_idle;
+	if (dl)
+		dl_idle = dl->next;
+	else if (dl_hung >= DL_MAXHUNG) {
+		pthread_mutex_unlock(&dl_mutex);
+		if (!hungwarn++)
+			fplog(stderr, WARN, "%i reads hanging, waiting for reads without deadline\n", dl_hung);
+		return ipread(fd, bf, sz, off, dioal, delay);
+	}
+	pthread_mutex_unlock(&dl_mutex);
+	if (!dl && !(dl = dl_new()))
+		return ipread(fd, bf, sz, off, dioal, delay);
+	if (sz > dl->bufsz) {
+		ZFREE(dl->origbuf);
+		dl->buf = zalloc_aligned_buf(sz, &dl->origbuf);
+		dl->bufsz = sz;
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += deadline/1000;
+	ts.tv_nsec += (deadline%1000)*1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		++ts.tv_sec;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&dl->mutex);
+	dl->fd = fd; dl->sz = sz; dl->off = off;
+	dl->dioal = dioal; dl->delay = delay;
+	dl->busy = 1;
+	pthread_cond_signal(&dl->cond);
+	while (dl->busy && rc != ETIMEDOUT)
+		rc = pthread_cond_timedwait(&dl->cond, &dl->mutex, &ts);
+	if (dl->busy) {
+		dl->abandoned = 1;
+		pthread_mutex_lock(&dl_mutex);
+		++dl_hung;
+		pthread_mutex_unlock(&dl_mutex);
+		pthread_mutex_unlock(&dl->mutex);
+		errno = ETIME;
+		return -1;
+	}
+	pthread_mutex_unlock(&dl->mutex);
+	const ssize_t rd = dl->res;
+	const int err = dl->err;
+	if (rd > 0)
+		memcpy(bf, dl->buf, rd);
+	pthread_mutex_lock(&dl_mutex);
+	dl->next = dl_idle;
+	dl_idle = dl;
+	pthread_mutex_unlock(&dl_mutex);
+	errno = err;
+	return rd;
+}
+
+/* Let the idle helper threads exit */
+static void dl_release()
+{
+	pthread_mutex_lock(&dl_mutex);
+	while (dl_idle) {
+		dlreader_t *dl = dl_idle;
+		dl_idle = dl->next;
+		pthread_mutex_lock(&dl->mutex);
+		dl->quit = 1;
+		pthread_cond_signal(&dl->cond);
+		pthread_mutex_unlock(&dl->mutex);
+	}
+	pthread_mutex_unlock(&dl_mutex);
+}
+#endif
+
 static inline ssize_t mypread(int fd, void* bf, size_t sz, loff_t off,
 			      opt_t *op, fstate_t *fst, repeat_t *rep, 
 			      dpopt_t *dop, dpstate_t *dst)
 {
 	/* TODO: Handle plugin input here ... */
 	/* Handle fault injection here */
-	if (read_faults) {
-		int fault = in_fault_list(read_faults, off/op->hardbs,
-					  (off+(loff_t)sz+(loff_t)(op->hardbs-1))/op->hardbs);
-		if (fault) {
-			fplog(stderr, DEBUG, "Inject read fault @ %li (rd %iblk @ %li*%i)\n",
-				(long)((fault-1)*op->hardbs+off), (sz+op->hardbs-1)/op->hardbs,
-				off/op->hardbs, op->hardbs);
-			if (!op->reverse && fst->fin_ipos && fst->ipos == fst->fin_ipos) {
-				/* EOF, we can't proceed any further */
-				errno = 0;
-				return 0;
-			} else {
-				errno = EIO;
-				return -1;
-			}
-			// Cloud read and return (fault-1)*op->hardbs bytes ...
-		}
-	}
+	if (read_faults && read_fault(off, sz, op, fst))
+		return errno? -1: 0;
 	/* Optimization for repeated read from same input */
 	if (op->i_repeat) {
 		if (rep->i_rep_init)
@@ -1708,11 +2529,26 @@ static inline ssize_t mypread(int fd, void* bf, size_t sz, loff_t off,
 	}
 	/* We won't make progress beyond EOF */
 	ssize_t rd;
+	struct timespec t0;
+	const unsigned int delay = slow_faults? slow_fault_delay(off/op->hardbs,
+				   (off+(loff_t)sz+(loff_t)(op->hardbs-1))/op->hardbs): 0;
+	if (latmap)
+		clock_gettime(CLOCK_MONOTONIC, &t0);
 	/* OK, regular read ... */
 	if (fst->i_chr)
 		rd = read(fd, bf, sz);
+#ifdef HAVE_SCSI_SG_H
+	else if (sgdev.lbsz && !(off % sgdev.lbsz) && !(sz % sgdev.lbsz))
+		rd = sg_pread(fd, (unsigned char*)bf, sz, off, op);
+#endif
+#ifdef USE_PTHREAD
+	else if (op->deadline)
+		rd = dl_pread(fd, (unsigned char*)bf, sz, off, fst->dio_ialign, delay, op->deadline);
+#endif
 	else
-		rd = pread64(fd, bf, sz, off);
+		rd = ipread(fd, (unsigned char*)bf, sz, off, fst->dio_ialign, delay);
+	if (latmap)
+		lat_record(&t0, 0, off, rd < 0);
 	if (rd == (ssize_t)-1 && !op->reverse && fst->fin_ipos && fst->ipos == fst->fin_ipos) {
 		errno = 0;
 		return 0;
@@ -1720,12 +2556,266 @@ static inline ssize_t mypread(int fd, void* bf, size_t sz, loff_t off,
 		return rd;
 }
 
-static inline ssize_t mypwrite(int fd, void* bf, size_t sz, loff_t off,
-			       opt_t *op, fstate_t *fst, progress_t *prg)
+#ifdef USE_PTHREAD
+/* Target prefetch for write avoidance (-W): A thread reads the output
+ * ahead of the write position into a ring of softbs buffers, so the
+ * comparison in mypwrite() doesn't wait for the read. Holes in the
+ * target are not read; they only match zero blocks. Forward only. */
+typedef struct _pfslot {
+	unsigned char *buf, *origbuf;
+	loff_t pos;
+	ssize_t rd;
+	char full, hole;
+} pfslot_t;
+
+typedef struct _tgtpf {
+	pfslot_t *slots;
+	unsigned int nslots, head, tail, bs, align;
+	int fd;
+	/* Next pos to read, end of target (-1 = unknown) */
+	loff_t next, eof;
+	/* SEEK_DATA cache: [hcpos,data[ is a hole, [data,hole[ data */
+	loff_t hcpos, data, hole;
+	char running, stop, done;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} tgtpf_t;
+
+static tgtpf_t *tgtpf;
+/* Bytes to read ahead */
+#define TGTPF_BYTES (16*1024*1024)
+
+static char tgtpf_ishole(tgtpf_t *pf, loff_t pos, loff_t len)
 {
-	/* TODO: Handle plugin output here ... */
-	/* Handle fault injection here */
-	if (write_faults) {
+#ifdef SEEK_DATA
+	if (pos < pf->hcpos || pos >= pf->hole) {
+		loff_t data = lseek64(pf->fd, pos, SEEK_DATA);
+		pf->hcpos = pos;
+		if (data != -1) {
+			pf->data = data;
+			pf->hole = lseek64(pf->fd, data, SEEK_HOLE);
+			if (pf->hole == -1)
+				pf->hole = LLONG_MAX;
+		} else if (errno == ENXIO) {
+			/* Only holes up to EOF */
+			pf->data = pf->hole = lseek64(pf->fd, 0, SEEK_END);
+		} else {
+			/* No info, assume data */
+			pf->data = pos; pf->hole = LLONG_MAX;
+		}
+	}
+	return pos+len <= pf->data;
+#else
+	return 0;
+#endif
+}
+
+static void* tgtpf_thread(void *arg)
+{
+	tgtpf_t *pf = (tgtpf_t*)arg;
+	pthread_mutex_lock(&pf->mutex);
+	while (!pf->stop) {
+		pfslot_t *sl = pf->slots + pf->tail;
+		if (sl->full) {
+			pthread_cond_wait(&pf->cond, &pf->mutex);
+			continue;
+		}
+		const loff_t pos = pf->next;
+		pthread_mutex_unlock(&pf->mutex);
+		/* Slot is not full, so the main thread won't touch it */
+		sl->pos = pos;
+		sl->hole = tgtpf_ishole(pf, pos, pf->bs);
+		if (sl->hole)
+			sl->rd = pf->bs;
+#ifdef O_DIRECT
+		else if (pf->align)
+			sl->rd = dio_pread(pf->fd, sl->buf, pf->bs, pos, pf->align);
+#endif
+		else
+			sl->rd = pread64(pf->fd, sl->buf, pf->bs, pos);
+		pthread_mutex_lock(&pf->mutex);
+		sl->full = 1;
+		pf->tail = (pf->tail+1) % pf->nslots;
+		pf->next += pf->bs;
+		pthread_cond_broadcast(&pf->cond);
+		/* End of target (or error) */
+		if (sl->rd < (ssize_t)pf->bs) {
+			pf->eof = pos + MAX(sl->rd, 0);
+			break;
+		}
+	}
+	pf->done = 1;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->mutex);
+	return NULL;
+}
+
+static void tgtpf_stop(tgtpf_t *pf)
+{
+	if (!pf->running)
+		return;
+	pthread_mutex_lock(&pf->mutex);
+	pf->stop = 1;
+	pthread_cond_broadcast(&pf->cond);
+	pthread_mutex_unlock(&pf->mutex);
+	pthread_join(pf->thread, NULL);
+	pf->running = 0;
+}
+
+/* (Re)start reading ahead at pos */
+static int tgtpf_start(tgtpf_t *pf, loff_t pos)
+{
+	unsigned int i;
+	tgtpf_stop(pf);
+	for (i = 0; i < pf->nslots; ++i)
+		pf->slots[i].full = 0;
+	pf->head = 0; pf->tail = 0;
+	pf->next = pos; pf->eof = -1;
+	pf->stop = 0; pf->done = 0;
+	int err = pthread_create(&pf->thread, NULL, tgtpf_thread, pf);
+	if (err)
+		return -err;
+	pf->running = 1;
+	return 0;
+}
+
+/* Called with pf->mutex held */
+static void tgtpf_release(tgtpf_t *pf)
+{
+	pf->slots[pf->head].full = 0;
+	pf->head = (pf->head+1) % pf->nslots;
+	pthread_cond_broadcast(&pf->cond);
+}
+
+/* Compare bf with the prefetched target: Returns 0 if identical,
+ * 1 if it differs and -1 if we don't have it (read it then) */
+static int tgtpf_compare(int fd, const unsigned char *bf, size_t sz, loff_t off)
+{
+	tgtpf_t *pf = tgtpf;
+	char restarted = 0;
+	int res = -1;
+	if (!pf || fd != pf->fd)
+		return -1;
+	pthread_mutex_lock(&pf->mutex);
+	while (1) {
+		pfslot_t *sl = pf->slots + pf->head;
+		if (sl->full && off >= sl->pos+(loff_t)pf->bs) {
+			/* We're past it */
+			tgtpf_release(pf);
+			continue;
+		}
+		if (sl->full && off >= sl->pos && sl->rd >= 0) {
+			if (off+(loff_t)sz <= sl->pos+sl->rd) {
+				pthread_mutex_unlock(&pf->mutex);
+				if (sl->hole)
+					res = find_nonzero(bf, sz) != sz;
+				else
+					res = memcmp(bf, sl->buf+(off-sl->pos), sz) != 0;
+				pthread_mutex_lock(&pf->mutex);
+				/* Done with it, or it's stale after the write */
+				if (res || off+(loff_t)sz == sl->pos+(loff_t)pf->bs)
+					tgtpf_release(pf);
+				break;
+			}
+			/* Target ends here */
+			if (sl->rd < (ssize_t)pf->bs) {
+				res = 1;
+				break;
+			}
+			/* Crossing into the next slot: Start over at off */
+		} else if (sl->full || (pf->running && off < pf->next))
+			/* Went back: Read it ourselves */
+			break;
+		else if (pf->running && !pf->done && off < pf->next+(loff_t)pf->bs) {
+			pthread_cond_wait(&pf->cond, &pf->mutex);
+			continue;
+		} else if (pf->done && pf->eof != -1 && off >= pf->eof) {
+			res = 1;
+			break;
+		}
+		/* Not where we're reading ahead: Start over at off */
+		if (restarted)
+			break;
+		restarted = 1;
+		pthread_mutex_unlock(&pf->mutex);
+		int err = tgtpf_start(pf, off);
+		pthread_mutex_lock(&pf->mutex);
+		if (err)
+			break;
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	return res;
+}
+
+static void tgtpf_init(opt_t *op, fstate_t *fst)
+{
+	unsigned int i;
+	tgtpf_t *pf = (tgtpf_t*)calloc(1, sizeof(tgtpf_t));
+	if (!pf)
+		return;
+	pf->bs = op->softbs;
+	pf->nslots = MAX(4, TGTPF_BYTES/op->softbs);
+	pf->slots = (pfslot_t*)calloc(pf->nslots, sizeof(pfslot_t));
+	if (!pf->slots) {
+		free(pf);
+		return;
+	}
+	for (i = 0; i < pf->nslots; ++i)
+		pf->slots[i].buf = zalloc_aligned_buf(pf->bs, &pf->slots[i].origbuf);
+	pf->fd = fst->odes;
+	pf->align = fst->dio_oalign;
+	pthread_mutex_init(&pf->mutex, NULL);
+	pthread_cond_init(&pf->cond, NULL);
+	tgtpf = pf;
+}
+
+static void tgtpf_free()
+{
+	unsigned int i;
+	tgtpf_t *pf = tgtpf;
+	if (!pf)
+		return;
+	tgtpf = NULL;
+	tgtpf_stop(pf);
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->mutex);
+	for (i = 0; i < pf->nslots; ++i)
+		ZFREE(pf->slots[i].origbuf);
+	free(pf->slots);
+	free(pf);
+}
+#endif
+
+/* pwrite to the output, taking care of O_DIRECT alignment */
+static inline ssize_t opwrite(int fd, void* bf, size_t sz, loff_t off, fstate_t *fst)
+{
+	ssize_t wr;
+	struct timespec t0;
+	if (latmap)
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (fst->o_chr)
+		wr = write(fd, bf, sz);
+#ifdef O_DIRECT
+	else if (fst->dio_oalign)
+		wr = dio_pwrite(fd, (unsigned char*)bf, sz, off, fst->dio_oalign);
+#endif
+	else
+		wr = pwrite64(fd, bf, sz, off);
+	if (latmap)
+		lat_record(&t0, 1, off, wr < 0);
+	return wr;
+}
+
+static inline ssize_t mypwrite(int fd, void* bf, size_t sz, loff_t off,
+			       opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	/* Crawling with hardbs: Collect blocks for the main output */
+	if (wcomb.active && fd == fst->odes && wcomb_add((const unsigned char*)bf, sz, off))
+		return sz;
+	/* TODO: Handle plugin output here ... */
+	/* Handle fault injection here */
+	if (write_faults) {
 		int fault = in_fault_list(write_faults, off/op->hardbs,
 					  (off+(loff_t)sz+(loff_t)(op->hardbs-1))/op->hardbs);
 		if (fault) {
@@ -1740,33 +2830,192 @@ static inline ssize_t mypwrite(int fd, void* bf, size_t sz, loff_t off,
 	/* Continue with real writes */
 	if (fst->o_chr) {
 		if (!op->avoidnull)
-			return write(fd, bf, sz);
+			return opwrite(fd, bf, sz, off, fst);
 		else {
 			prg->axfer += sz;
 			return sz;
 		}
 	} else {
 		if (op->avoidwrite) {
-			ssize_t ln = pread64(fd, fst->buf2, sz, off);
+			ssize_t ln;
+#ifdef USE_PTHREAD
+			const int cmp = tgtpf_compare(fd, (const unsigned char*)bf, sz, off);
+			if (cmp == 1)
+				return opwrite(fd, bf, sz, off, fst);
+			if (cmp == 0) {
+				prg->axfer += sz;
+				return sz;
+			}
+#endif
+#ifdef O_DIRECT
+			if (fst->dio_oalign)
+				ln = dio_pread(fd, fst->buf2, sz, off, fst->dio_oalign);
+			else
+#endif
+				ln = pread64(fd, fst->buf2, sz, off);
 			if (ln < (ssize_t)sz)
-				return pwrite64(fd, bf, sz, off);
+				return opwrite(fd, bf, sz, off, fst);
 			if (memcmp(bf, fst->buf2, ln))
-				return pwrite64(fd, bf, sz, off);
+				return opwrite(fd, bf, sz, off, fst);
 			else {
 				prg->axfer += ln;
 				return ln;
 			}
 		} else
-			return pwrite64(fd, bf, sz, off);
+			return opwrite(fd, bf, sz, off, fst);
+	}
+}
+
+/* mmap input (-I): fst->buf points into a window of the mapped input
+ * instead of getting a copy; the pages are touched under a SIGBUS guard,
+ * so media errors end up in the normal read error handling. */
+typedef struct _mmwin {
+	unsigned char *addr, *bounce;
+	loff_t off, isize;
+	size_t len;
+} mmwin_t;
+static mmwin_t mmwin;
+#define MMWIN_SIZE (64*1024*1024)
+static sigjmp_buf mm_jmp;
+static volatile sig_atomic_t mm_guard;
+
+static void mm_sigbus(int sig)
+{
+	if (mm_guard) {
+		mm_guard = 0;
+		siglongjmp(mm_jmp, 1);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static int mm_init(fstate_t *fst)
+{
+	mmwin.isize = lseek64(fst->ides, 0, SEEK_END);
+	if (mmwin.isize <= 0)
+		return -1;
+	mmwin.bounce = fst->buf;
+	signal(SIGBUS, mm_sigbus);
+	return 0;
+}
+
+static void mm_release(fstate_t *fst)
+{
+	if (!mmwin.bounce)
+		return;
+	if (mmwin.addr)
+		munmap(mmwin.addr, mmwin.len);
+	fst->buf = mmwin.bounce;
+	memset(&mmwin, 0, sizeof(mmwin));
+}
+
+/* Make sure [start,end[ is mapped, moving the window in copy direction */
+static int mm_window(loff_t start, loff_t end, opt_t *op, fstate_t *fst)
+{
+	if (mmwin.addr && start >= mmwin.off && end <= mmwin.off+(loff_t)mmwin.len)
+		return 0;
+	if (mmwin.addr)
+		munmap(mmwin.addr, mmwin.len);
+	mmwin.addr = NULL;
+	loff_t len = MAX(MMWIN_SIZE, end-start+(loff_t)op->pagesize);
+	loff_t off = op->reverse? end-len: start;
+	if (off < 0)
+		off = 0;
+	off -= off % op->pagesize;
+	/* Backwards, the window needs to reach up to end still */
+	if (op->reverse)
+		len = end - off;
+	if (off+len > mmwin.isize)
+		len = mmwin.isize - off;
+	void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fst->ides, off);
+	if (addr == MAP_FAILED)
+		return -errno;
+	madvise(addr, len, op->reverse? MADV_NORMAL: MADV_SEQUENTIAL);
+	mmwin.addr = (unsigned char*)addr;
+	mmwin.off = off; mmwin.len = len;
+	return 0;
+}
+
+static ssize_t mm_readblock(const int toread, opt_t *op, fstate_t *fst)
+{
+	const loff_t pos = fst->ipos - op->reverse*toread;
+	ssize_t rd = toread;
+	volatile ssize_t good = 0;
+	fst->buf = mmwin.bounce;
+	if (read_faults && read_fault(pos, toread, op, fst))
+		return 0;
+	if (pos >= mmwin.isize) {
+		errno = 0;
+		return 0;
+	}
+	if (pos+rd > mmwin.isize)
+		rd = mmwin.isize - pos;
+	int err = mm_window(pos, pos+rd, op, fst);
+	if (err) {
+		fplog(stderr, WARN, "mmap %s (%skiB): %s, falling back to read\n",
+		      op->iname, fmt_kiB(pos, !nocol), strerror(-err));
+		mm_release(fst);
+		errno = 0;
+		return -2;
+	}
+	unsigned char *bf = mmwin.addr + (pos - mmwin.off);
+	/* Fault the pages in here, where we can catch SIGBUS */
+	mm_guard = 1;
+	if (!sigsetjmp(mm_jmp, 1)) {
+		while (good < rd) {
+			(void)*(volatile unsigned char*)(bf+good);
+			good += op->pagesize - (unsigned long)(bf+good) % op->pagesize;
+		}
+		good = rd;
+	}
+	mm_guard = 0;
+	if (good < rd) {
+		/* Error handling writes to the buffer, so use the real one */
+		memcpy(mmwin.bounce, bf, good);
+		errno = EIO;
+		return good;
 	}
+	fst->buf = bf;
+	errno = 0;
+	return rd;
 }
 
+#ifdef HAVE_POSIX_FADVISE
+/* The kernel does not read ahead backwards: For reverse copies (-r, -J),
+ * have the revahead bytes below the read at pos read in, topping up
+ * whenever less than half of that is left */
+static void rev_readahead(loff_t pos, opt_t *op, fstate_t *fst)
+{
+	/* Start over after jumps (first read, skipped holes, next pass) */
+	if (pos > fst->ra_pos || pos < fst->ra_lo)
+		fst->ra_lo = pos;
+	fst->ra_pos = pos;
+	if (fst->ra_lo && pos - fst->ra_lo < op->revahead/2) {
+		const loff_t lo = MAX(0, pos - op->revahead);
+		posix_fadvise64(fst->ides, lo, fst->ra_lo - lo, POSIX_FADV_WILLNEED);
+		fst->ra_lo = lo;
+	}
+}
+#endif
 
 ssize_t readblock(const int toread,
 		  opt_t *op, fstate_t *fst, repeat_t *rep,
 		  dpopt_t *dop, dpstate_t *dst)
 {
 	ssize_t err, rd = 0;
+	tbucket_take(&rd_bucket, toread);
+#ifdef HAVE_POSIX_FADVISE
+	/* Not while falling back to hardbs after errors */
+	if (op->reverse && op->revahead && !fst->dio_ialign
+	    && (toread > (int)op->hardbs || op->softbs == op->hardbs))
+		rev_readahead(fst->ipos - toread, op, fst);
+#endif
+	if (mmwin.bounce) {
+		rd = mm_readblock(toread, op, fst);
+		if (rd != -2)
+			return rd;
+		rd = 0;
+	}
 	//errno = 0; /* should not be necessary */
 	do {
 		rd += (err = mypread(fst->ides, fst->buf+rd, toread-rd, fst->ipos+rd-op->reverse*toread, op, fst, rep, dop, dst));
@@ -1778,6 +3027,346 @@ ssize_t readblock(const int toread,
 	return (/*err == -1? err:*/ rd);
 }
 
+#ifdef USE_PTHREAD
+/* Drop a reference to b, returning it to the pool when unused;
+ * called with owrs->mutex held */
+static void owbuf_put(owbuf_t *b)
+{
+	if (--b->refs)
+		return;
+	b->next = owrs->pool;
+	owrs->pool = b;
+}
+
+/* Write one block to a secondary output, just reporting errors */
+static void owr_write(owriter_t *w, owbuf_t *b)
+{
+	ssize_t e2, w2 = 0;
+	ofile_t *oft = w->of;
+	errno = 0;
+	do {
+		w2 += (e2 = mypwrite(oft->fd, b->buf+w2, b->len-w2, b->pos+w2, &w->op, &w->fst, &w->prg));
+		if (e2 == -1)
+			w2++;
+	} while ((e2 == -1 && (errno == EINTR || errno == EAGAIN))
+		  || (w2 < (ssize_t)b->len && e2 > 0 && errno == 0));
+	if (w2 < (ssize_t)b->len && e2 != 0) {
+		fplog(stderr, WARN, "2ndary write %s (%skiB): %s\n",
+		      oft->name, fmt_kiB(b->pos, !nocol), strerror(errno));
+		++w->errs;
+	} else
+		w->written += b->len;
+}
+
+static void* owriter_thread(void *arg)
+{
+	owriter_t *w = (owriter_t*)arg;
+	pthread_mutex_lock(&owrs->mutex);
+	while (1) {
+		while (!w->n && !owrs->eof)
+			pthread_cond_wait(&w->cond, &owrs->mutex);
+		if (!w->n)
+			break;
+		owbuf_t *b = w->q[w->head];
+		pthread_mutex_unlock(&owrs->mutex);
+		owr_write(w, b);
+		pthread_mutex_lock(&owrs->mutex);
+		w->head = (w->head+1) % owrs->qlen;
+		--w->n;
+		owbuf_put(b);
+		/* Wake producer waiting for space */
+		pthread_cond_signal(&w->cond);
+	}
+	pthread_mutex_unlock(&owrs->mutex);
+	/* fsync in parallel with the other outputs */
+	if (!owrs->abort) {
+		w->errs += sync_close(w->of->fd, w->of->name, w->of->cdev, &w->op, &w->fst);
+		w->of->fd = -1;
+	}
+	gettimeofday(&w->end, NULL);
+	return NULL;
+}
+
+/* Queue a block for all secondary outputs; waits while the queue
+ * of an output is full (backpressure) */
+static void owriters_queue(const unsigned char *wbuf, const int towrite, const loff_t pos)
+{
+	unsigned int i;
+	owbuf_t *b;
+	pthread_mutex_lock(&owrs->mutex);
+	b = owrs->pool;
+	if (b)
+		owrs->pool = b->next;
+	pthread_mutex_unlock(&owrs->mutex);
+	if (b && b->cap < (unsigned int)towrite) {
+		free(b->origbuf);
+		free(b);
+		b = NULL;
+	}
+	if (!b) {
+		b = (owbuf_t*)malloc(sizeof(owbuf_t));
+		assert(b);
+		b->cap = MAX((unsigned int)towrite, owrs->bs);
+		b->buf = zalloc_aligned_buf(b->cap, &b->origbuf);
+	}
+	memcpy(b->buf, wbuf, towrite);
+	b->len = towrite; b->pos = pos;
+	b->refs = owrs->nwr;
+	pthread_mutex_lock(&owrs->mutex);
+	for (i = 0; i < owrs->nwr; ++i) {
+		owriter_t *w = owrs->wr+i;
+		while (w->n == owrs->qlen)
+			pthread_cond_wait(&w->cond, &owrs->mutex);
+		w->q[(w->head+w->n) % owrs->qlen] = b;
+		++w->n;
+		pthread_cond_signal(&w->cond);
+	}
+	pthread_mutex_unlock(&owrs->mutex);
+}
+
+/* Wait for the secondary outputs to write all queued blocks */
+static void owriters_drain()
+{
+	unsigned int i;
+	pthread_mutex_lock(&owrs->mutex);
+	for (i = 0; i < owrs->nwr; ++i)
+		while (owrs->wr[i].n)
+			pthread_cond_wait(&owrs->wr[i].cond, &owrs->mutex);
+	pthread_mutex_unlock(&owrs->mutex);
+}
+
+/* No more blocks: writers finish their queues, then fsync and close */
+static void owriters_eof(fstate_t *fst)
+{
+	unsigned int i;
+	pthread_mutex_lock(&owrs->mutex);
+	owrs->eof = 1;
+	for (i = 0; i < owrs->nwr; ++i) {
+		owrs->wr[i].fst.opos = fst->opos;
+		pthread_cond_signal(&owrs->wr[i].cond);
+	}
+	pthread_mutex_unlock(&owrs->mutex);
+}
+
+static void owriters_free(const unsigned int started)
+{
+	unsigned int i;
+	for (i = 0; i < started; ++i)
+		pthread_join(owrs->wr[i].thread, NULL);
+	for (i = 0; i < owrs->nwr; ++i) {
+		owriter_t *w = owrs->wr+i;
+		ZFREE(w->fst.origbuf2);
+		free(w->q);
+		pthread_cond_destroy(&w->cond);
+	}
+	while (owrs->pool) {
+		owbuf_t *b = owrs->pool;
+		owrs->pool = b->next;
+		free(b->origbuf);
+		free(b);
+	}
+	pthread_mutex_destroy(&owrs->mutex);
+	free(owrs->wr);
+	free(owrs);
+	owrs = NULL;
+}
+
+/* Join writers (after owriters_eof()) and report per output */
+static void owriters_close(opt_t *op)
+{
+	unsigned int i;
+	for (i = 0; i < owrs->nwr; ++i)
+		pthread_join(owrs->wr[i].thread, NULL);
+	for (i = 0; i < owrs->nwr && !op->quiet; ++i) {
+		owriter_t *w = owrs->wr+i;
+		const double t = w->end.tv_sec - w->start.tv_sec
+				 + 1e-6*(w->end.tv_usec - w->start.tv_usec);
+		fplog(stderr, INFO, "%s: %skiB written, %i errors, %.1fMB/s\n",
+		      w->of->name, fmt_kiB(w->written, !nocol), w->errs,
+		      (t > 0? w->written/t/1e6: 0.0));
+	}
+	owriters_free(0);
+}
+
+/* Start one writer thread per secondary output */
+static void owriters_start(opt_t *op, fstate_t *fst)
+{
+	unsigned int i = 0, j;
+	LISTTYPE(ofile_t) *of;
+	const unsigned int nwr = LISTSIZE(ofiles, ofile_t);
+	owrs = (owriters_t*)calloc(1, sizeof(owriters_t));
+	if (!owrs)
+		return;
+	owrs->wr = (owriter_t*)calloc(nwr, sizeof(owriter_t));
+	if (!owrs->wr) {
+		free(owrs); owrs = NULL;
+		return;
+	}
+	owrs->nwr = nwr;
+	owrs->bs = op->softbs;
+	owrs->qlen = MAX(4, OWR_QBYTES/op->softbs);
+	pthread_mutex_init(&owrs->mutex, NULL);
+	LISTFOREACH(ofiles, of) {
+		owriter_t *w = owrs->wr + i++;
+		w->of = &LISTDATA(of);
+		w->op = *op;
+		w->fst = *fst;
+		w->fst.o_chr = w->of->cdev;
+		w->fst.dio_oalign = w->of->dioal;
+		w->fst.buf2 = NULL; w->fst.origbuf2 = NULL;
+		if (op->avoidwrite)
+			w->fst.buf2 = zalloc_aligned_buf(op->softbs, &w->fst.origbuf2);
+		w->q = (owbuf_t**)calloc(owrs->qlen, sizeof(owbuf_t*));
+		assert(w->q);
+		pthread_cond_init(&w->cond, NULL);
+	}
+	for (i = 0; i < nwr; ++i) {
+		owriter_t *w = owrs->wr+i;
+		gettimeofday(&w->start, NULL);
+		int err = pthread_create(&w->thread, NULL, owriter_thread, w);
+		if (err) {
+			fplog(stderr, WARN, "could not start writer for %s: %s; writing serially\n",
+			      w->of->name, strerror(err));
+			pthread_mutex_lock(&owrs->mutex);
+			owrs->eof = 1; owrs->abort = 1;
+			for (j = 0; j < i; ++j)
+				pthread_cond_signal(&owrs->wr[j].cond);
+			pthread_mutex_unlock(&owrs->mutex);
+			owriters_free(i);
+			return;
+		}
+	}
+}
+#endif
+
+/* Make sure the secondary outputs have everything on disk */
+static void sync_ofiles()
+{
+	LISTTYPE(ofile_t) *of;
+#ifdef USE_PTHREAD
+	if (owrs)
+		owriters_drain();
+#endif
+	LISTFOREACH(ofiles, of)
+		fsync(LISTDATA(of).fd);
+}
+
+/* Write combining: While crawling through damaged areas with hardbs,
+ * every good block would be a write syscall of its own (and maybe a
+ * read-modify-write on the target); collect contiguous blocks and
+ * write them when softbs is full or at a softbs aligned boundary.
+ * Flushed before jumps, syncs, map file checkpoints and on exit. */
+static char wcomb_start(opt_t *op, fstate_t *fst, progress_t *prg, dpopt_t *dop)
+{
+	const unsigned int cap = op->softbs - op->softbs % op->hardbs;
+	if (wcomb.active || fst->o_chr || op->avoidwrite || op->worker || cap < 2*op->hardbs)
+		return 0;
+	if (wcomb.cap != cap) {
+		ZFREE(wcomb.origbuf);
+		wcomb.buf = zalloc_aligned_buf(cap, &wcomb.origbuf);
+		wcomb.cap = cap;
+	}
+	wcomb.op = op; wcomb.fst = fst;
+	wcomb.prg = prg; wcomb.dop = dop;
+	wcomb.len = 0;
+	wcomb.fatal = 0;
+	wcomb.active = 1;
+	return 1;
+}
+
+/* Write the collected blocks; if that fails, write them one by one
+ * to find and report the bad ones (like real_writeblock() does) */
+static void wcomb_flush()
+{
+	const unsigned int len = wcomb.len;
+	unsigned char *bf = wcomb.buf + wcomb.start;
+	unsigned int off = 0;
+	if (!len)
+		return;
+	opt_t *op = wcomb.op;
+	fstate_t *fst = wcomb.fst;
+	/* Not again from exit_report() -> cleanup() */
+	wcomb.len = 0;
+	wcomb.active = 0;
+	while (off < len) {
+		const ssize_t wr = mypwrite(fst->odes, bf+off, len-off, wcomb.pos+off, op, fst, wcomb.prg);
+		if (wr > 0)
+			off += wr;
+		else if (wr == 0 || (errno != EINTR && errno != EAGAIN))
+			break;
+	}
+	if (off < len)
+		fplog(stderr, INFO, "retrying writes with smaller blocks \n");
+	while (off < len) {
+		const unsigned int ln = MIN(op->hardbs, len-off);
+		ssize_t wr;
+		do {
+			wr = mypwrite(fst->odes, bf+off, ln, wcomb.pos+off, op, fst, wcomb.prg);
+		} while (wr == -1 && (errno == EINTR || errno == EAGAIN));
+		if (wr < (ssize_t)ln) {
+			const int eno = wr < 0? errno: ENOSPC;
+			const char fatal = is_writeerr_fatal(eno, op);
+			fplog(stderr, (op->abwrerr || fatal? FATAL: WARN), "write %s (%skiB): %s\n",
+			      op->oname, fmt_kiB(wcomb.pos+off, !nocol), strerror(eno));
+			/* Was marked good when we took it, so -K retries it */
+			mapmark(wcomb.pos+off+wcomb.ioff, fatal? len-off: ln, RMAP_UNTRIED, op);
+			if (op->abwrerr)
+				exit_report(21, op, fst, wcomb.prg, wcomb.dop);
+			fst->nrerr++;
+			++wcomb.errs;
+			/* No point in going on, hardbs_crawl() stops as well */
+			if (fatal) {
+				wcomb.fatal = 1;
+				break;
+			}
+		}
+		off += ln;
+	}
+	wcomb.active = 1;
+}
+
+/* Flush and stop collecting; returns the number of write errors */
+static int wcomb_stop()
+{
+	int errs;
+	wcomb_flush();
+	wcomb.active = 0;
+	errs = wcomb.errs;
+	wcomb.errs = 0;
+	return errs;
+}
+
+/* Take the block for output position off; 0 if it needs to be written directly */
+static char wcomb_add(const unsigned char *bf, size_t sz, loff_t off)
+{
+	const char rev = wcomb.op->reverse;
+	const loff_t ioff = wcomb.fst->ipos - wcomb.fst->opos;
+	/* Aligned boundary reached: The next writes will be aligned.
+	 * (Not flushed right away, the caller still marks that block good) */
+	if (wcomb.len && !((rev? wcomb.pos: wcomb.pos+wcomb.len) % wcomb.cap))
+		wcomb_flush();
+	if (wcomb.len && (ioff != wcomb.ioff
+			  || (rev? off+(loff_t)sz != wcomb.pos: off != wcomb.pos+wcomb.len)))
+		wcomb_flush();
+	if (wcomb.len + sz > wcomb.cap)
+		wcomb_flush();
+	if (sz > wcomb.cap)
+		return 0;
+	if (!wcomb.len) {
+		wcomb.ioff = ioff;
+		wcomb.start = rev? wcomb.cap: 0;
+		wcomb.pos = off + (rev? sz: 0);
+	}
+	if (rev) {
+		wcomb.start -= sz;
+		wcomb.pos -= sz;
+		memcpy(wcomb.buf+wcomb.start, bf, sz);
+	} else
+		memcpy(wcomb.buf+wcomb.start+wcomb.len, bf, sz);
+	wcomb.len += sz;
+	return 1;
+}
+
 /* write a block from fst->buf to fst->odes at fst->opos
  * also writes to secondary output files
  * The plugin chain will be called.
@@ -1789,6 +3378,7 @@ ssize_t real_writeblock(unsigned char* wbuf, int towrite, char *retry,
 	ssize_t wr = 0;
 	int lasterr = 0;
 	assert(fst->opos >= 0);
+	tbucket_take(&wr_bucket, towrite);
 	//errno = 0; /* should not be necessary */
 	/* Loop for EINTR/EAGAIN and for incomplete writes that make progress */
 	do {
@@ -1849,13 +3439,22 @@ ssize_t real_writeblock(unsigned char* wbuf, int towrite, char *retry,
 		}
 	}
 	totwr += wr;
+#ifdef USE_PTHREAD
+	if (owrs) {
+		if (towrite)
+			owriters_queue(wbuf, towrite, fst->opos-op->reverse*towrite);
+		return lasterr? -lasterr: totwr;
+	}
+#endif
 	/* Handle multiple output files, NO error handling, just reporting */
 	char oldochr = fst->o_chr;
+	const unsigned int olddioal = fst->dio_oalign;
 	LISTTYPE(ofile_t) *of;
 	LISTFOREACH(ofiles, of) {
 		ssize_t e2, w2 = 0;
 		ofile_t *oft = &(LISTDATA(of));
 		fst->o_chr = oft->cdev;
+		fst->dio_oalign = oft->dioal;
 		do {
 			w2 += (e2 = mypwrite(oft->fd, wbuf+w2, towrite-w2, fst->opos+w2-op->reverse*towrite, op, fst, prg));
 			if (e2 == -1)
@@ -1867,6 +3466,7 @@ ssize_t real_writeblock(unsigned char* wbuf, int towrite, char *retry,
 			      oft->name, fmt_kiB(fst->opos, !nocol), strerror(errno));
 	}
 	fst->o_chr = oldochr;
+	fst->dio_oalign = olddioal;
 	return lasterr? -lasterr: totwr;
 }
 
@@ -1884,6 +3484,11 @@ ssize_t writeblock(int towrite, int* shouldwrite,
 	int redo;
 	unsigned char* wbuf;
 	//*shouldwrite = 0;
+#ifdef USE_PTHREAD
+	const char plug_lock = op->worker && plugins_opened;
+	if (plug_lock)
+		pthread_mutex_lock(&plug_mutex);
+#endif
 #if 0
 	fplog(stderr, DEBUG, "writeblock entry pos %zd/%zd: %i\n",
 		fst->ipos, fst->opos, towrite);
@@ -2002,6 +3607,10 @@ ssize_t writeblock(int towrite, int* shouldwrite,
 #endif
 	fst->ipos -= adv_ipos;
 	fst->opos -= adv_opos;
+#ifdef USE_PTHREAD
+	if (plug_lock)
+		pthread_mutex_unlock(&plug_mutex);
+#endif
 	return lasterr;
 }
 
@@ -2069,52 +3678,201 @@ static void advancepos(const ssize_t rd, const ssize_t wr, const ssize_t rwr,
 #endif
 	//lastskip = 1;
 	if (op->reverse) { 
+		mapmark(fst->ipos-rd, rd, RMAP_GOOD, op);
 		fst->ipos -= rd; fst->opos -= wr; 
 	} else { 
+		mapmark(fst->ipos, rd, RMAP_GOOD, op);
 		fst->ipos += rd; fst->opos += wr; 
 	}
+#ifdef HAVE_POSIX_FADVISE
+	if (op->evict)
+		evict_behind(op, fst);
+#endif
 }
 
-static int is_writeerr_fatal(int err, opt_t *op)
+/* Old output contents in the regions sparse mode (-a) skips are zeroed
+ * (or punched out), so block devices and existing files end up correct.
+ * Adjacent skips are collected and done in one go. */
+typedef struct _zrun {
+	loff_t pos, len, ioff;
+	loff_t oldsize;
+	unsigned int align;
+	char mode, nopunch, nozeroout;
+	opt_t *op;
+	fstate_t *fst;
+	progress_t *prg;
+} zrun_t;
+static zrun_t zrun;
+#define ZR_FILE 1
+#define ZR_BLKDEV 2
+
+static void zrun_init(opt_t *op, fstate_t *fst)
 {
-	return (err == ENOSPC || err == EROFS
-#ifdef EDQUOT
-               || err == EDQUOT
+	struct STAT64 stbuf;
+	memset(&zrun, 0, sizeof(zrun));
+	if (!can_zero_skipped(op) || fst->o_chr || FSTAT64(fst->odes, &stbuf))
+		return;
+	if (S_ISBLK(stbuf.st_mode)) {
+		int ssz = 512;
+#ifdef BLKSSZGET
+		if (ioctl(fst->odes, BLKSSZGET, &ssz) || ssz <= 0)
+			ssz = 512;
 #endif
-               || (err == EFBIG && !op->reverse));
+		zrun.align = ssz;
+		zrun.mode = ZR_BLKDEV;
+	} else if (S_ISREG(stbuf.st_mode) && stbuf.st_size) {
+		zrun.oldsize = stbuf.st_size;
+		zrun.mode = ZR_FILE;
+	}
 }
 
-/* Do write, returns 0 for success, 1 for error, -1 for fatal error
- * Advances position IF AND ONLY IF return value is NOT negative
- * fst->opos should point to beginning of block (fwd copy)
- * resp. byte 0 of next block (rev copy) */
-ssize_t dowrite(const ssize_t rd, opt_t *op, fstate_t *fst, 
-		progress_t *prg, dpopt_t *dop)
+/* Write zeros the hard way */
+static int zero_write(loff_t pos, loff_t len, opt_t *op, fstate_t *fst, progress_t *prg)
 {
-	int err = 0;
-	int fatal = 0;
-	ssize_t wr = 0;
-	int shouldwr = 0;
-	err = ((wr = writeblock(rd, &shouldwr, op, fst, prg, dop)) < 0 ? -wr: 0);
-	if (err && is_writeerr_fatal(err, op))
-		++fatal;
-	if (err) {
-		fplog(stderr, WARN, "assumption rd(%zi) == wr(%zi) failed! \n", rd, wr);
-		fplog(stderr, (fatal? FATAL: WARN),
-			"write %s (%skiB): %s!\n", 
-			op->oname, fmt_kiB(fst->opos/*+wr*/, !nocol), strerror(err));
-		/* No retry at this high level, move on -- this breaks plugins that
-		 * don't handle sparse but what can we do? */
-		if (plug_not_sparse)
-			fplog(stderr, FATAL, "output file will be broken (plugins don't handle sparse)\n");
-		// Advance in case of write errors
-		advancepos(rd, shouldwr, 0, op, fst, prg);
-		//lastskip = 0;
-		return fatal? -1: 1;
-	} else {
-		advancepos(rd, shouldwr, wr, op, fst, prg);
-		//lastskip = 0;
-		if (wr != shouldwr) {
+	static unsigned char zbuf[65536] __attribute__((aligned(4096)));
+	const size_t chunk = MIN(sizeof(zbuf), op->softbs);
+	while (len > 0) {
+		ssize_t wr = mypwrite(fst->odes, zbuf, MIN(len, (loff_t)chunk), pos, op, fst, prg);
+		if (wr <= 0)
+			return -1;
+		pos += wr; len -= wr;
+	}
+	return 0;
+}
+
+static int zero_out(loff_t pos, loff_t len, opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	if (zrun.mode == ZR_FILE) {
+		/* Beyond the old end of file, we have holes already */
+		if (pos >= zrun.oldsize)
+			return 0;
+		len = MIN(len, zrun.oldsize-pos);
+#if defined(HAVE_FALLOCATE64) && defined(FALLOC_FL_PUNCH_HOLE)
+		if (!zrun.nopunch && !fallocate64(fst->odes, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len))
+			return 0;
+# ifdef FALLOC_FL_ZERO_RANGE
+		if (!zrun.nopunch && !fallocate64(fst->odes, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, pos, len))
+			return 0;
+# endif
+		zrun.nopunch = 1;
+#endif
+	}
+#ifdef BLKZEROOUT
+	else if (!zrun.nozeroout) {
+		/* The kernel zeroes aligned ranges (with write zeroes or
+		 * discard if the device supports it), we write the rest */
+		const loff_t head = (zrun.align - pos%zrun.align) % zrun.align;
+		uint64_t range[2] = { pos+head, 0 };
+		if (len > head)
+			range[1] = (len-head) - (len-head)%zrun.align;
+		if (range[1] && !ioctl(fst->odes, BLKZEROOUT, range)) {
+			const loff_t tail = len-head-range[1];
+			if (head && zero_write(pos, head, op, fst, prg))
+				return -1;
+			if (tail && zero_write(range[0]+range[1], tail, op, fst, prg))
+				return -1;
+			return 0;
+		}
+		if (range[1])
+			zrun.nozeroout = 1;
+	}
+#endif
+	return zero_write(pos, len, op, fst, prg);
+}
+
+/* The skipped range was marked good already; undo if zeroing fails */
+static void zero_skipped(loff_t pos, loff_t len, loff_t ioff, opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	if (!zero_out(pos, len, op, fst, prg))
+		return;
+	fplog(stderr, WARN, "zeroing %s (%skiB+%skiB): %s\n",
+	      op->oname, fmt_kiB(pos, !nocol), fmt_kiB(len, !nocol), strerror(errno));
+	fst->nrerr++;
+	mapmark(pos+ioff, len, RMAP_UNTRIED, op);
+}
+
+static void zrun_flush(opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	const loff_t len = zrun.len;
+	/* Clear first, zero_skipped() may end up in mapmark() */
+	zrun.len = 0;
+	if (len)
+		zero_skipped(zrun.pos, len, zrun.ioff, op, fst, prg);
+}
+
+/* Zero what we have before the map file records it as done */
+static void zrun_checkpoint()
+{
+	if (zrun.len)
+		zrun_flush(zrun.op, zrun.fst, zrun.prg);
+}
+
+/* Move over a zero block or hole without writing it in sparse mode */
+static void sparse_skip(const ssize_t ln, opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	const loff_t opos = op->reverse? fst->opos-ln: fst->opos;
+	const loff_t ioff = fst->ipos - fst->opos;
+	advancepos(ln, plug_unsparse? 0: ln, 0, op, fst, prg);
+	if (!zrun.mode || plug_unsparse || ln <= 0)
+		return;
+	/* -j workers share the output but not our state */
+	if (op->worker) {
+		zero_skipped(opos, ln, ioff, op, fst, prg);
+		return;
+	}
+	if (zrun.len && ioff == zrun.ioff && opos == zrun.pos+zrun.len)
+		zrun.len += ln;
+	else if (zrun.len && ioff == zrun.ioff && opos+ln == zrun.pos) {
+		zrun.pos = opos; zrun.len += ln;
+	} else {
+		zrun_flush(op, fst, prg);
+		zrun.pos = opos; zrun.len = ln; zrun.ioff = ioff;
+		zrun.op = op; zrun.fst = fst; zrun.prg = prg;
+	}
+}
+
+static int is_writeerr_fatal(int err, opt_t *op)
+{
+	return (err == ENOSPC || err == EROFS
+#ifdef EDQUOT
+               || err == EDQUOT
+#endif
+               || (err == EFBIG && !op->reverse));
+}
+
+/* Do write, returns 0 for success, 1 for error, -1 for fatal error
+ * Advances position IF AND ONLY IF return value is NOT negative
+ * fst->opos should point to beginning of block (fwd copy)
+ * resp. byte 0 of next block (rev copy) */
+ssize_t dowrite(const ssize_t rd, opt_t *op, fstate_t *fst, 
+		progress_t *prg, dpopt_t *dop)
+{
+	int err = 0;
+	int fatal = 0;
+	ssize_t wr = 0;
+	int shouldwr = 0;
+	err = ((wr = writeblock(rd, &shouldwr, op, fst, prg, dop)) < 0 ? -wr: 0);
+	if (err && is_writeerr_fatal(err, op))
+		++fatal;
+	if (err) {
+		fplog(stderr, WARN, "assumption rd(%zi) == wr(%zi) failed! \n", rd, wr);
+		fplog(stderr, (fatal? FATAL: WARN),
+			"write %s (%skiB): %s!\n", 
+			op->oname, fmt_kiB(fst->opos/*+wr*/, !nocol), strerror(err));
+		/* No retry at this high level, move on -- this breaks plugins that
+		 * don't handle sparse but what can we do? */
+		if (plug_not_sparse)
+			fplog(stderr, FATAL, "output file will be broken (plugins don't handle sparse)\n");
+		// Advance in case of write errors
+		advancepos(rd, shouldwr, 0, op, fst, prg);
+		/* Data did not make it, so leave for a retry on resume */
+		mapmark(op->reverse? fst->ipos: fst->ipos-rd, rd, RMAP_UNTRIED, op);
+		//lastskip = 0;
+		return fatal? -1: 1;
+	} else {
+		advancepos(rd, shouldwr, wr, op, fst, prg);
+		//lastskip = 0;
+		if (wr != shouldwr) {
 			fplog(stderr, DEBUG, "Should have written %i, but only %i done\n");
 			return 1;
 		}
@@ -2158,7 +3916,7 @@ ssize_t dowrite_sparse(const ssize_t rd, opt_t *op, fstate_t *fst,
 	/* Also simple: Whole block is empty, so just move on */
 	if (zln >= rd) {
 		fplog(stderr, DEBUG, "skip complete block @ ipos %zd (opos %zd)\n", fst->ipos, fst->opos);
-		advancepos(rd, plug_unsparse? 0: rd, 0, op, fst, prg);
+		sparse_skip(rd, op, fst, prg);
 		return 0;
 	}
 	/* Block is smaller than 2*opts->hardbs and not completely zero, so don't bother optimizing ... */
@@ -2173,14 +3931,14 @@ ssize_t dowrite_sparse(const ssize_t rd, opt_t *op, fstate_t *fst,
 		fplog(stderr, DEBUG, "skip ~half block @ ipos %lld (ln %zd)\n", fst->ipos, zln);
 		/* Reverse: Leave at end, Fwd: Skip over empty parts zln */
 		if (!op->reverse)
-			advancepos(zln, plug_unsparse? 0: zln, 0, op, fst, prg);
+			sparse_skip(zln, op, fst, prg);
 		fst->buf += zln;
 		/* Reverse: Moves backward by (rd-zln); Fwd: Moves forward by (rd-zln) */
 		ssize_t wr = dowrite(rd-zln, op, fst, prg, dop);
 		fst->buf = oldbuf;
 		/* Reverse: Need to move backware by zln, Fwd: We're all set already */
 		if (op->reverse)
-			advancepos(zln, plug_unsparse? 0: zln, 0, op, fst, prg);
+			sparse_skip(zln, op, fst, prg);
 		return wr;
 	}
 	/* Check second half */
@@ -2192,10 +3950,10 @@ ssize_t dowrite_sparse(const ssize_t rd, opt_t *op, fstate_t *fst,
 				fst->ipos, mid, zln2);
 		/* Rev: Move end of block */
 		if (op->reverse)
-			advancepos(rd-mid, plug_unsparse? 0: rd-mid, 0, op, fst, prg);
+			sparse_skip(rd-mid, op, fst, prg);
 		ssize_t wr = dowrite(mid, op, fst, prg, dop);
 		if (!op->reverse)
-			advancepos(rd-mid, plug_unsparse? 0: rd-mid, 0, op, fst, prg);
+			sparse_skip(rd-mid, op, fst, prg);
 		return wr;
 	}
 }
@@ -2213,20 +3971,129 @@ static int partialwrite(const ssize_t rd, opt_t *op, fstate_t *fst,
 
 static int updstat = 8;
 
-int copyfile_hardbs(const loff_t max, opt_t *op, fstate_t *fst,
-		    progress_t *prg, repeat_t *rep, 
-		    dpopt_t *dop, dpstate_t *dst)
+#ifdef SEEK_DATA
+/* Layout of the input file as reported by SEEK_DATA/SEEK_HOLE:
+ * [data,hole[ is the current or next data region */
+typedef struct _holecache {
+	loff_t data, hole;
+	char off;
+} holecache_t;
+
+static void holecache_init(holecache_t *hc, opt_t *op, fstate_t *fst)
+{
+	memset(hc, 0, sizeof(*hc));
+	hc->off = !op->sparse || op->reverse || fst->i_chr || op->i_repeat;
+}
+
+/* Sparse copy (-a) from a regular file: Jump over holes in the input
+ * without reading them. Plugins see the ipos jump just like for
+ * zero blocks that dowrite_sparse() skips. Returns bytes skipped. */
+static loff_t skip_holes(holecache_t *hc, const loff_t max,
+			 opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	if (hc->off)
+		return 0;
+	if (fst->ipos >= hc->hole) {
+		loff_t data = lseek64(fst->ides, fst->ipos, SEEK_DATA);
+		if (data == -1) {
+			/* Not supported (e.g. block dev) */
+			if (errno != ENXIO) {
+				hc->off = 1;
+				errno = 0;
+				return 0;
+			}
+			/* Hole up to EOF */
+			data = lseek64(fst->ides, 0, SEEK_END);
+			errno = 0;
+		}
+		hc->data = data;
+		hc->hole = lseek64(fst->ides, data, SEEK_HOLE);
+		if (hc->hole == -1) {
+			hc->hole = data;
+			errno = 0;
+		}
+	}
+	if (fst->ipos >= hc->data)
+		return 0;
+	loff_t skip = hc->data - fst->ipos;
+	if (max && skip > max - prg->xfer)
+		skip = max - prg->xfer;
+	const loff_t skipped = skip;
+	fplog(stderr, DEBUG, "skip hole @ ipos %lld (ln %lld)\n", fst->ipos, skip);
+	while (skip > 0) {
+		const ssize_t sk = skip > 0x40000000? 0x40000000: skip;
+		sparse_skip(sk, op, fst, prg);
+		skip -= sk;
+	}
+	return skipped;
+}
+#endif
+
+#if defined(O_DIRECT) && defined(HAVE_POSIX_FADVISE)
+/* Within error regions, the page cache works against us: Readahead
+ * pulls in the neighbouring bad sectors and the kernel retries every
+ * failed page. So buffered input is switched to O_DIRECT and
+ * POSIX_FADV_RANDOM on the first read error and back once the copy
+ * is promoted to softbs again. */
+static char errdio;
+
+static void errdio_on(opt_t *op, fstate_t *fst)
+{
+	if (errdio || fst->dio_ialign || fst->i_chr || op->buffered || op->mmapin
+	    || op->dosplice || op->offload || op->uring_qd || op->pipe_bufs
+	    || op->worker || op->sgio_tmo)
+		return;
+	const int flags = fcntl(fst->ides, F_GETFL);
+	if (flags == -1 || fcntl(fst->ides, F_SETFL, flags | O_DIRECT))
+		return;
+	fst->dio_ialign = dio_setup(fst->ides, 1, 0, op->iname);
+	if (!fst->dio_ialign)
+		return;
+	posix_fadvise64(fst->ides, 0, 0, POSIX_FADV_RANDOM);
+	errdio = 1;
+	fplog(stderr, DEBUG, "read errors: switching %s to O_DIRECT\n", op->iname);
+}
+
+static void errdio_off(opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	if (!errdio)
+		return;
+	const int flags = fcntl(fst->ides, F_GETFL);
+	if (flags != -1)
+		fcntl(fst->ides, F_SETFL, flags & ~O_DIRECT);
+	fst->dio_ialign = 0;
+	errdio = 0;
+	posix_fadvise64(fst->ides, 0, 0, POSIX_FADV_NORMAL);
+	fadvise(0, op, fst, prg);
+	fplog(stderr, DEBUG, "no more read errors: buffered reads from %s again\n", op->iname);
+}
+#else
+static inline void errdio_on(opt_t *op, fstate_t *fst) {}
+static inline void errdio_off(opt_t *op, fstate_t *fst, progress_t *prg) {}
+#endif
+
+static int hardbs_crawl(const loff_t max, opt_t *op, fstate_t *fst,
+			progress_t *prg, repeat_t *rep,
+			dpopt_t *dop, dpstate_t *dst)
 {
 	ssize_t toread;
 	int errs = 0; errno = 0;
+#ifdef SEEK_DATA
+	holecache_t hc;
+	holecache_init(&hc, op, fst);
+#endif
 #if 0	
 	fprintf(stderr, "%s%s%s%s copyfile (fstate->ipos=%.1fk, progress->xfer=%.1fk, max=%.1fk, bs=%i)                         ##\n%s%s%s%s",
 		up, up, up, up,
 		(double)fstate->ipos/1024, (double)progress->xfer/1024, (double)max/1024, opts->hardbs,
 		down, down, down, down);
 #endif
-	while ((toread = blockxfer(max, op->hardbs, op, fst, prg)) > 0 && !interrupted) { 
+	while ((toread = blockxfer(max, op->hardbs, op, fst, prg)) > 0 && !interrupted && !wcomb.fatal) { 
 		int eno;
+#ifdef SEEK_DATA
+		if (skip_holes(&hc, max, op, fst, prg))
+			continue;
+#endif
 		ssize_t rd = readblock(toread, op, fst, rep, dop, dst);
 		eno = errno;
 
@@ -2274,6 +4141,7 @@ int copyfile_hardbs(const loff_t max, opt_t *op, fstate_t *fst,
 			}					
 			/* Real error on small blocks: Don't retry */
 			fst->nrerr++; 
+			errdio_on(op, fst);
 			loff_t pos = (op->reverse? fst->ipos - toread: fst->ipos);
 			fplog(stderr, WARN, "read %s (%skiB): %s!\n", 
 			      op->iname, fmt_kiB(pos, !nocol), strerror(eno));
@@ -2303,10 +4171,10 @@ int copyfile_hardbs(const loff_t max, opt_t *op, fstate_t *fst,
 				 	*/
 				}
 			}
-			savebb(pos/op->hardbs, op);
 			updgraph(1, fst, dop, op);
 			prg->fxfer += toread;
 			advancepos(toread, toread, 0, op, fst, prg);
+			savebb(pos, toread, op);
 			/* exit if too many errs */
 			if (op->maxerr && fst->nrerr >= op->maxerr) {
 				fplog(stderr, FATAL, "maxerr reached!\n");
@@ -2331,19 +4199,310 @@ int copyfile_hardbs(const loff_t max, opt_t *op, fstate_t *fst,
 		/* else print regularly acc. to updstat if not quiet */
 		else if (!op->quiet && !(fst->ipos % (updstat*op->softbs/2)))
 			printstatus(stderr, 0, op->hardbs, 0, op, fst, prg, dop);
-		/* even if quiet, we need to call the printstatus if we do rate limiting */
-		else if (op->quiet && op->maxkbs && !(fst->ipos % (updstat*op->softbs/2)))
-			printstatus(0, 0, op->hardbs, 0, op, fst, prg, dop);
 	} /* remain */
 	return errs;
 }
 
+int copyfile_hardbs(const loff_t max, opt_t *op, fstate_t *fst,
+		    progress_t *prg, repeat_t *rep, 
+		    dpopt_t *dop, dpstate_t *dst)
+{
+	const char comb = wcomb_start(op, fst, prg, dop);
+	int errs = hardbs_crawl(max, op, fst, prg, rep, dop, dst);
+	if (comb) {
+		const int werrs = wcomb_stop();
+		if (errs >= 0)
+			errs += werrs;
+		/* Fatal write error, like dowrite() */
+		if (wcomb.fatal)
+			return -1;
+	}
+	return errs;
+}
+
+#ifdef USE_PTHREAD
+/* Read-ahead pipeline: A reader thread fills a ring of softbs buffers,
+ * copyfile_softbs() consumes them strictly in order (softbs_readblock)
+ * and does the writing (incl. the plugin chain) on the main thread.
+ * The reader stops after a read error or short read; the main thread
+ * then does the usual fallback to hardbs and restarts the reader
+ * once it asks for a block at a position the ring does not have. */
+typedef struct _rdslot {
+	unsigned char *buf, *origbuf;
+	loff_t ipos;
+	ssize_t rd;
+	int toread, eno;
+	char full;
+} rdslot_t;
+
+typedef struct _rdring {
+	rdslot_t *slots;
+	unsigned int nslots, head, tail;
+	int held;
+	char running, stop, done;
+	pthread_t reader;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/* Reader thread's view */
+	loff_t max;
+	fstate_t rfst;
+	progress_t rprg;
+	opt_t *op;
+	repeat_t *rep;
+	dpopt_t *dop;
+	dpstate_t *dst;
+	unsigned char *mainbuf;
+} rdring_t;
+
+static rdring_t *rdring;
+
+static void* rdring_reader(void *arg)
+{
+	rdring_t *rr = (rdring_t*)arg;
+	opt_t *op = rr->op;
+	pthread_mutex_lock(&rr->mutex);
+	while (!rr->stop) {
+		rdslot_t *sl = rr->slots + rr->tail;
+		if (sl->full) {
+			pthread_cond_wait(&rr->cond, &rr->mutex);
+			continue;
+		}
+		const int toread = blockxfer(rr->max, op->softbs, op, &rr->rfst, &rr->rprg);
+		if (toread <= 0)
+			break;
+		pthread_mutex_unlock(&rr->mutex);
+		/* Slot is not full, so the main thread won't touch it */
+		rr->rfst.buf = sl->buf;
+		sl->ipos = rr->rfst.ipos;
+		sl->toread = toread;
+		errno = 0;
+		sl->rd = readblock(toread, op, &rr->rfst, rr->rep, rr->dop, rr->dst);
+		sl->eno = errno;
+		if (op->reverse) {
+			rr->rfst.ipos -= toread; rr->rfst.opos -= toread;
+		} else {
+			rr->rfst.ipos += toread; rr->rfst.opos += toread;
+		}
+		rr->rprg.xfer += toread;
+		pthread_mutex_lock(&rr->mutex);
+		sl->full = 1;
+		rr->tail = (rr->tail+1) % rr->nslots;
+		pthread_cond_broadcast(&rr->cond);
+		/* Errors and EOF are for the main thread to handle */
+		if (sl->rd < toread)
+			break;
+	}
+	rr->done = 1;
+	pthread_cond_broadcast(&rr->cond);
+	pthread_mutex_unlock(&rr->mutex);
+	return NULL;
+}
+
+static void rdring_stop(rdring_t *rr)
+{
+	if (!rr->running)
+		return;
+	pthread_mutex_lock(&rr->mutex);
+	rr->stop = 1;
+	pthread_cond_broadcast(&rr->cond);
+	pthread_mutex_unlock(&rr->mutex);
+	pthread_join(rr->reader, NULL);
+	rr->running = 0;
+}
+
+/* (Re)start the reader at the current position, dropping read-ahead data.
+ * Must be called without a held slot. */
+static int rdring_start(rdring_t *rr, fstate_t *fst, progress_t *prg)
+{
+	unsigned int i;
+	rdring_stop(rr);
+	for (i = 0; i < rr->nslots; ++i)
+		rr->slots[i].full = 0;
+	rr->head = 0; rr->tail = 0;
+	rr->rfst = *fst;
+	rr->rprg = *prg;
+	rr->stop = 0; rr->done = 0;
+	int err = pthread_create(&rr->reader, NULL, rdring_reader, rr);
+	if (err) {
+		fplog(stderr, WARN, "can't start reader thread: %s\n", strerror(err));
+		return -err;
+	}
+	rr->running = 1;
+	return 0;
+}
+
+/* Like readblock(), but take the data from the read-ahead ring
+ * if it is active. fst->buf will point to the ring buffer. */
+ssize_t softbs_readblock(const int toread,
+			 opt_t *op, fstate_t *fst, progress_t *prg,
+			 repeat_t *rep, dpopt_t *dop, dpstate_t *dst)
+{
+	rdring_t *rr = rdring;
+	char restarted = 0;
+	if (!rr)
+		return readblock(toread, op, fst, rep, dop, dst);
+	pthread_mutex_lock(&rr->mutex);
+	/* Done with the previous block */
+	if (rr->held >= 0) {
+		rr->slots[rr->held].full = 0;
+		rr->held = -1;
+		pthread_cond_broadcast(&rr->cond);
+	}
+	while (1) {
+		rdslot_t *sl = rr->slots + rr->head;
+		if (sl->full && sl->ipos == fst->ipos && sl->toread == toread) {
+			rr->held = rr->head;
+			rr->head = (rr->head+1) % rr->nslots;
+			pthread_mutex_unlock(&rr->mutex);
+			fst->buf = sl->buf;
+			errno = sl->eno;
+			return sl->rd;
+		}
+		if (!sl->full && rr->running && !rr->done) {
+			pthread_cond_wait(&rr->cond, &rr->mutex);
+			continue;
+		}
+		/* Ring does not have what we need (position moved by the
+		 * hardbs fallback or reader stopped): restart it here */
+		pthread_mutex_unlock(&rr->mutex);
+		if (restarted || rdring_start(rr, fst, prg))
+			break;
+		restarted = 1;
+		pthread_mutex_lock(&rr->mutex);
+	}
+	/* Should not happen: Do it synchronously */
+	rdring_stop(rr);
+	fst->buf = rr->mainbuf;
+	return readblock(toread, op, fst, rep, dop, dst);
+}
+#else
+static inline ssize_t softbs_readblock(const int toread,
+			 opt_t *op, fstate_t *fst, progress_t *prg,
+			 repeat_t *rep, dpopt_t *dop, dpstate_t *dst)
+{
+	return readblock(toread, op, fst, rep, dop, dst);
+}
+#endif
+
+/* Adaptive softbs (-G): Hill climbing on the throughput measured over
+ * windows of BSCTL_WINDOW us, doubling/halving the block size between
+ * bc->min and the allocated op->softbs. Read errors and latency spikes
+ * make it shrink (and stay small for a few windows). */
+#define BSCTL_WINDOW 250000
+#define BSCTL_HOLD 4
+
+typedef struct _bsctl {
+	int cur, min, max;
+	int dir, hold;
+	loff_t wbytes;
+	struct timeval wstart;
+	double lastrate, nspb;
+	unsigned int samples;
+} bsctl_t;
+
+static int bsctl_valid(const int bs, const bsctl_t *bc, opt_t *op)
+{
+	return bs >= bc->min && bs <= bc->max && !(bs % op->hardbs)
+		&& (!plug_max_req_align || !(bs % plug_max_req_align));
+}
+
+static void bsctl_newwindow(bsctl_t *bc)
+{
+	bc->wbytes = 0;
+	gettimeofday(&bc->wstart, NULL);
+}
+
+static void bsctl_init(bsctl_t *bc, opt_t *op)
+{
+	int i;
+	memset(bc, 0, sizeof(*bc));
+	bc->max = op->softbs;
+	bc->min = MAX(op->hardbs, op->pagesize);
+	if (bc->min > bc->max)
+		bc->min = bc->max;
+	/* Start at 1/8 and grow */
+	bc->cur = bc->max;
+	for (i = 0; i < 3 && bsctl_valid(bc->cur/2, bc, op); ++i)
+		bc->cur /= 2;
+	bc->dir = 1;
+	bsctl_newwindow(bc);
+}
+
+static void bsctl_resize(bsctl_t *bc, const int dir, opt_t *op)
+{
+	const int nbs = dir > 0? bc->cur*2: bc->cur/2;
+	if (bsctl_valid(nbs, bc, op)) {
+		bc->cur = nbs;
+		/* Latency per byte depends on the block size */
+		bc->samples = 0;
+		if (op->verbose) {
+			fplog(stderr, DEBUG, "adaptive softbs: %i\n", nbs);
+			scrollup = 0;
+		}
+	}
+	bsctl_newwindow(bc);
+}
+
+/* Account for a block of rd bytes that took rdtime us to read */
+static void bsctl_update(bsctl_t *bc, const ssize_t rd, const long rdtime,
+			 const int err, opt_t *op)
+{
+	struct timeval now;
+	if (err) {
+		/* Errors tend to cluster: Go small and stay there for a while */
+		bsctl_resize(bc, -1, op);
+		bsctl_resize(bc, -1, op);
+		bc->hold = BSCTL_HOLD;
+		bc->dir = 1;
+		bc->lastrate = 0;
+		return;
+	}
+	if (rd > 0) {
+		const double nspb = 1000.0*rdtime/rd;
+		if (bc->samples >= 8 && nspb > 8*bc->nspb) {
+			/* Latency spike: Back off */
+			bsctl_resize(bc, -1, op);
+			bc->hold = 1;
+			bc->dir = 1;
+			bc->lastrate = 0;
+			return;
+		}
+		bc->nspb = bc->samples? (7*bc->nspb + nspb)/8: nspb;
+		++bc->samples;
+	}
+	bc->wbytes += rd;
+	gettimeofday(&now, NULL);
+	const long elapsed = (now.tv_sec - bc->wstart.tv_sec)*1000000 + now.tv_usec - bc->wstart.tv_usec;
+	if (elapsed < BSCTL_WINDOW)
+		return;
+	const double rate = (double)bc->wbytes*1e6/elapsed;
+	if (bc->hold) {
+		--bc->hold;
+		bc->lastrate = rate;
+		bsctl_newwindow(bc);
+		return;
+	}
+	if (bc->lastrate) {
+		/* Got worse: Turn around; about the same: Stay */
+		if (rate < 0.95*bc->lastrate)
+			bc->dir = -bc->dir;
+		else if (rate < 1.05*bc->lastrate) {
+			bc->lastrate = rate;
+			bsctl_newwindow(bc);
+			return;
+		}
+	}
+	bc->lastrate = rate;
+	bsctl_resize(bc, bc->dir, op);
+}
+
 int copyfile_softbs(const loff_t max, opt_t *op, fstate_t *fst,
 		    progress_t *prg, repeat_t *rep, 
 		    dpopt_t *dop, dpstate_t *dst)
 {
 	ssize_t toread;
 	int errs = 0, rc; int eno;
+	bsctl_t bc;
 #if 0	
 	fprintf(stderr, "%s%s%s%s copyfile (fstate->ipos=%.1fk, progress->xfer=%.1fk, max=%.1fk, bs=%i)                         ##\n%s%s%s%s",
 		up, up, up, up,
@@ -2358,11 +4517,29 @@ int copyfile_softbs(const loff_t max, opt_t *op, fstate_t *fst,
 			fplog(stderr, WARN, "extending file %s to %skiB failed\n",
 			      op->oname, fmt_kiB(fst->opos, !nocol));
 	}
+	if (op->adaptive)
+		bsctl_init(&bc, op);
+#ifdef SEEK_DATA
+	holecache_t hc;
+	holecache_init(&hc, op, fst);
+#endif
 	errno = 0;
-	while ((toread = blockxfer(max, op->softbs, op, fst, prg)) > 0 && !interrupted) {
+	while ((toread = blockxfer(max, op->adaptive? bc.cur: (int)op->softbs, op, fst, prg)) > 0 && !interrupted) {
 		int err;
-		ssize_t rd = readblock(toread, op, fst, rep, dop, dst);
+		struct timeval t0, t1;
+#ifdef SEEK_DATA
+		if (skip_holes(&hc, max, op, fst, prg))
+			continue;
+#endif
+		if (op->adaptive)
+			gettimeofday(&t0, NULL);
+		ssize_t rd = softbs_readblock(toread, op, fst, prg, rep, dop, dst);
 		eno = errno;
+		if (op->adaptive) {
+			gettimeofday(&t1, NULL);
+			bsctl_update(&bc, rd, (t1.tv_sec-t0.tv_sec)*1000000 + t1.tv_usec-t0.tv_usec,
+				     rd < toread && eno, op);
+		}
 
 		/* EOF */
 		if (rd == 0 && !eno) {
@@ -2392,6 +4569,7 @@ int copyfile_softbs(const loff_t max, opt_t *op, fstate_t *fst,
 				++errs;
 				/* Read error occurred: Print warning */
 				printstatus(stderr, logfd, op->softbs, 1, op, fst, prg, dop);
+				errdio_on(op, fst);
 			}
 			/* Some errnos are fatal */
 			exitfatalerr(eno, op, fst, prg, dop);
@@ -2416,6 +4594,8 @@ int copyfile_softbs(const loff_t max, opt_t *op, fstate_t *fst,
 				errs += ret;
 			old_xfer = prg->xfer;
 			errs += (err = copyfile_hardbs(new_max, op, fst, prg, rep, dop, dst));
+			if (err < 0)
+				return err;
 			/* EOF */
 			if (!err && old_xfer == prg->xfer)
 				return errs;
@@ -2429,68 +4609,1093 @@ int copyfile_softbs(const loff_t max, opt_t *op, fstate_t *fst,
 			   large ones without errors */
 			new_max = prg->xfer;
 			while (err && (!max || (max-prg->xfer > 0)) && ((!op->reverse) || (fst->ipos > 0 && fst->opos > 0))) {
-				new_max += 2*op->softbs; old_xfer = prg->xfer;
+				new_max += 2*(op->adaptive? bc.cur: (int)op->softbs); old_xfer = prg->xfer;
 				if (max && new_max > max) 
 					new_max = max;
 				errs += (err = copyfile_hardbs(new_max,  op, fst, prg, rep, dop, dst));
+				if (err < 0)
+					return err;
+			}
+			errno = 0;
+			/* EOF ? */      
+			if (!err && prg->xfer == old_xfer)
+				return errs;
+			errdio_off(op, fst, prg);
+			if (op->verbose) {
+				fprintf(stderr, DDR_DEBUG "ipos %skiB promote to large bs again! \n",
+					fmt_kiB(fst->ipos, !nocol));
+				scrollup = 0;
+			}
+		} else {
+			err = dowrite_sparse(rd, op, fst, prg, rep, dop);
+			if (err < 0)
+				return -err;
+			else
+				errs += err;
+		} /* errno */
+
+		errno = 0;
+		/* If we sync regularly, let's print a status update on each sync */
+		if (op->syncfreq && !(fst->ipos % (op->syncfreq*op->softbs)))
+			printstatus((op->quiet? 0: stderr), 0, op->softbs, 1, op, fst, prg, dop);
+		/* else print regularly acc. to updstat if not quiet */
+		else if (!op->quiet && !(fst->ipos % (2*updstat*op->softbs)))
+			printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
+	} /* remain */
+	return errs;
+}
+
+/* Resume (-K): Only copy the regions that the map file does not
+ * list as good, jumping over the rest (keeping ipos - opos constant) */
+int copyfile_resume(const loff_t max, opt_t *op, fstate_t *fst,
+		    progress_t *prg, repeat_t *rep,
+		    dpopt_t *dop, dpstate_t *dst)
+{
+	const loff_t odiff = fst->opos - fst->ipos;
+	loff_t lim = op->reverse? fst->fin_ipos:
+		(fst->fin_ipos? fst->fin_ipos: (max? op->init_ipos+max: 0));
+	int errs = 0;
+	if (op->reverse && max && op->init_ipos - max > lim)
+		lim = op->init_ipos - max;
+	if (!op->quiet) {
+		const loff_t todo = op->reverse? fst->ipos - lim: lim - fst->ipos;
+		if (todo > 0)
+			fplog(stderr, INFO, "resume: %skiB of %skiB not yet good\n",
+			      fmt_kiB(todo - rmap_count(rmap, op->reverse? lim: fst->ipos,
+					op->reverse? fst->ipos: lim, RMAP_GOOD), !nocol),
+			      fmt_kiB(todo, !nocol));
+	}
+	while (!interrupted) {
+		loff_t len, pos;
+		if (op->reverse)
+			pos = rmap_prev_nongood(rmap, fst->ipos, lim, &len);
+		else
+			pos = rmap_next_nongood(rmap, fst->ipos, lim, &len);
+		if (pos < 0)
+			break;
+		fst->ipos = pos; fst->opos = pos + odiff;
+		if (op->reverse && fst->opos < len)
+			len = fst->opos;
+		const loff_t new_max = len == -1? 0: prg->xfer + len;
+		if (op->softbs > op->hardbs)
+			errs += copyfile_softbs(new_max, op, fst, prg, rep, dop, dst);
+		else
+			errs += copyfile_hardbs(new_max, op, fst, prg, rep, dop, dst);
+		/* EOF or fatal error */
+		if (!new_max || prg->xfer != new_max)
+			break;
+	}
+	return errs;
+}
+
+/* Multi-pass (-N): Copy one block of toread bytes at fst->ipos (ending
+ * there for reverse). Read errors leave positions and output untouched
+ * and are counted in *rderrs (and fst->nrerr, for maxerr).
+ * Returns bytes read (< toread on EOF), -1 on read error, -2 if fatal */
+static ssize_t mp_copyblock(const int toread, int *errs, int *rderrs, opt_t *op, fstate_t *fst,
+			    progress_t *prg, repeat_t *rep,
+			    dpopt_t *dop, dpstate_t *dst)
+{
+	int err;
+	errno = 0;
+	const ssize_t rd = readblock(toread, op, fst, rep, dop, dst);
+	const int eno = errno;
+	if (rd < toread && eno) {
+		exitfatalerr(eno, op, fst, prg, dop);
+		/* Counts for -e, like the hardbs errors later */
+		++fst->nrerr; ++*rderrs;
+		if (op->maxerr && fst->nrerr >= op->maxerr) {
+			fplog(stderr, FATAL, "maxerr reached!\n");
+			exit_report(32, op, fst, prg, dop);
+		}
+		return -1;
+	}
+	if (rd < toread)
+		err = partialwrite(rd, op, fst, prg, rep, dop);
+	else
+		err = dowrite_sparse(rd, op, fst, prg, rep, dop);
+	if (err < 0)
+		return -2;
+	*errs += err;
+	return rd;
+}
+
+static void mp_pass(const int pass, const char *what, opt_t *op)
+{
+	if (op->quiet)
+		return;
+	fplog(stderr, INFO, "pass %i: %s\n", pass, what);
+	scrollup = 0;
+}
+
+#define MP_MAXSKIP (1024*1024*1024)
+
+/* Multi-pass rescue (-N), working on the states in the map:
+ * 1. Copy untried regions with softbs; after a read error, mark the
+ *    block non-trimmed and skip ahead (doubling on consecutive errors),
+ * 2. Copy the skipped regions backwards with softbs (no skipping),
+ * 3. Trim non-trimmed blocks from both edges with hardbs until the first
+ *    error on each side, marking the rest non-scraped,
+ * 4. Scrape non-scraped regions with hardbs (backwards with -J).
+ * So the good data is saved before we crawl through the bad areas. */
+int copyfile_multipass(const loff_t max, opt_t *op, fstate_t *fst,
+		       progress_t *prg, repeat_t *rep,
+		       dpopt_t *dop, dpstate_t *dst)
+{
+	const loff_t odiff = fst->opos - fst->ipos;
+	const loff_t beg = fst->ipos;
+	loff_t lim = fst->fin_ipos? fst->fin_ipos: (max? op->init_ipos+max: 0);
+	loff_t pos, len, skip = 0;
+	loff_t maxskip = lim? MAX((lim-beg)/16, op->softbs): MP_MAXSKIP;
+	int errs = 0, rderrs = 0, blks = 0;
+	ssize_t rc;
+	if (maxskip > MP_MAXSKIP)
+		maxskip = MP_MAXSKIP;
+	maxskip -= maxskip % op->softbs;
+
+	/* Pass 1: Forward, skip over bad areas */
+	mp_pass(1, "copying, skipping bad areas", op);
+	pos = beg;
+	while (!interrupted && (pos = rmap_next(rmap, pos, lim, RMAP_UNTRIED, &len)) >= 0) {
+		const loff_t rend = len == -1? 0: pos+len;
+		while (!interrupted && (!rend || pos < rend)) {
+			const int toread = (rend && rend-pos < op->softbs)? rend-pos: op->softbs;
+			fst->ipos = pos; fst->opos = pos+odiff;
+			rc = mp_copyblock(toread, &errs, &rderrs, op, fst, prg, rep, dop, dst);
+			if (rc == -2)
+				return errs+1;
+			if (rc >= 0) {
+				pos = fst->ipos;
+				skip = 0;
+				if (rc < toread) {
+					lim = pos;
+					break;
+				}
+			} else {
+				mapmark(pos, toread, RMAP_NONTRIMMED, op);
+				skip = skip? 2*skip: 2*op->softbs;
+				if (skip > maxskip)
+					skip = maxskip;
+				if (op->verbose) {
+					fplog(stderr, INFO, "read error at %skiB, skipping %skiB\n",
+					      fmt_kiB(pos, !nocol), fmt_kiB(skip, !nocol));
+					scrollup = 0;
+				}
+				pos += toread + skip;
+			}
+			if (!(++blks % (2*updstat)))
+				printstatus(op->quiet? 0: stderr, 0, op->softbs, 0, op, fst, prg, dop);
+		}
+		if (lim && pos >= lim)
+			break;
+	}
+	if (interrupted || !lim)
+		return errs;
+
+	/* Pass 2: Skipped areas, backwards */
+	mp_pass(2, "copying skipped areas backwards", op);
+	op->reverse = 1;
+	pos = lim;
+	while (!interrupted && (pos = rmap_prev(rmap, pos, beg, RMAP_UNTRIED, &len)) >= 0) {
+		const loff_t rbeg = pos - len;
+		while (!interrupted && pos > rbeg) {
+			const int toread = pos-rbeg < op->softbs? pos-rbeg: op->softbs;
+			fst->ipos = pos; fst->opos = pos+odiff;
+			rc = mp_copyblock(toread, &errs, &rderrs, op, fst, prg, rep, dop, dst);
+			if (rc == -2) {
+				op->reverse = 0;
+				return errs+1;
+			}
+			if (rc == toread)
+				pos = fst->ipos;
+			else if (rc >= 0) {
+				/* EOF is before the block end (skipped beyond it) */
+				lim = pos - toread + rc;
+				pos = lim;
+				break;
+			} else {
+				mapmark(pos-toread, toread, RMAP_NONTRIMMED, op);
+				pos -= toread;
+			}
+			if (!(++blks % (2*updstat)))
+				printstatus(op->quiet? 0: stderr, 0, op->softbs, 0, op, fst, prg, dop);
+		}
+	}
+	op->reverse = 0;
+	/* The bad sectors in there are counted by the hardbs passes */
+	fst->nrerr -= rderrs;
+
+	/* Pass 3: Trim bad areas from both edges */
+	mp_pass(3, "trimming bad areas", op);
+	pos = beg;
+	while (!interrupted && (pos = rmap_next(rmap, pos, lim, RMAP_NONTRIMMED, &len)) >= 0) {
+		loff_t lo = pos, hi = pos+len;
+		while (!interrupted && lo < hi) {
+			const int nrerr = fst->nrerr;
+			fst->ipos = lo; fst->opos = lo+odiff;
+			rc = copyfile_hardbs(prg->xfer + MIN(op->hardbs, hi-lo), op, fst, prg, rep, dop, dst);
+			if (rc < 0) {
+				op->reverse = 0;
+				return errs+1;
+			}
+			errs += rc;
+			if (fst->ipos == lo)
+				break;
+			lo = fst->ipos;
+			if (fst->nrerr != nrerr)
+				break;
+		}
+		op->reverse = 1;
+		while (!interrupted && hi > lo) {
+			const int nrerr = fst->nrerr;
+			fst->ipos = hi; fst->opos = hi+odiff;
+			rc = copyfile_hardbs(prg->xfer + MIN(op->hardbs, hi-lo), op, fst, prg, rep, dop, dst);
+			if (rc < 0) {
+				op->reverse = 0;
+				return errs+1;
+			}
+			errs += rc;
+			if (fst->ipos == hi)
+				break;
+			hi = fst->ipos;
+			if (fst->nrerr != nrerr)
+				break;
+		}
+		op->reverse = 0;
+		if (interrupted)
+			break;
+		mapmark(lo, hi-lo, RMAP_NONSCRAPED, op);
+		pos += len;
+	}
+
+	/* Pass 4: Scrape the rest sector by sector */
+	mp_pass(4, op->revscrape? "scraping backwards": "scraping", op);
+	op->reverse = op->revscrape;
+	pos = op->revscrape? lim: beg;
+	while (!interrupted) {
+		const loff_t oldxfer = prg->xfer;
+		if (op->revscrape)
+			pos = rmap_prev(rmap, pos, beg, RMAP_NONSCRAPED, &len);
+		else
+			pos = rmap_next(rmap, pos, lim, RMAP_NONSCRAPED, &len);
+		if (pos < 0)
+			break;
+		fst->ipos = pos; fst->opos = pos+odiff;
+		rc = copyfile_hardbs(prg->xfer + len, op, fst, prg, rep, dop, dst);
+		if (rc < 0) {
+			op->reverse = 0;
+			return errs+1;
+		}
+		errs += rc;
+		pos = fst->ipos;
+		if (prg->xfer - oldxfer != len)
+			break;
+	}
+	op->reverse = 0;
+	if (!interrupted) {
+		fst->ipos = lim; fst->opos = lim+odiff;
+	}
+	return errs;
+}
+
+#ifdef USE_PTHREAD
+/* copyfile_softbs() with a reader thread reading ahead into
+ * op->pipe_bufs buffers, so reads and writes overlap */
+int copyfile_pipeline(const loff_t max, opt_t *op, fstate_t *fst,
+		      progress_t *prg, repeat_t *rep,
+		      dpopt_t *dop, dpstate_t *dst)
+{
+	rdring_t rr;
+	unsigned int i;
+	int err;
+	memset(&rr, 0, sizeof(rr));
+	rr.nslots = op->pipe_bufs;
+	rr.slots = (rdslot_t*)calloc(rr.nslots, sizeof(rdslot_t));
+	if (!rr.slots) {
+		fplog(stderr, FATAL, "allocation of %i ring slots failed!\n", rr.nslots);
+		cleanup(1); exit(18);
+	}
+	for (i = 0; i < rr.nslots; ++i)
+		rr.slots[i].buf = zalloc_aligned_buf(op->softbs, &rr.slots[i].origbuf);
+	pthread_mutex_init(&rr.mutex, NULL);
+	pthread_cond_init(&rr.cond, NULL);
+	rr.held = -1;
+	rr.max = max;
+	rr.op = op; rr.rep = rep; rr.dop = dop; rr.dst = dst;
+	rr.mainbuf = fst->buf;
+	if (rdring_start(&rr, fst, prg))
+		err = copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+	else {
+		rdring = &rr;
+		err = copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+		rdring = NULL;
+		rdring_stop(&rr);
+	}
+	fst->buf = rr.mainbuf;
+	pthread_cond_destroy(&rr.cond);
+	pthread_mutex_destroy(&rr.mutex);
+	for (i = 0; i < rr.nslots; ++i)
+		ZFREE(rr.slots[i].origbuf);
+	free(rr.slots);
+	return err;
+}
+
+/* Called with jobs->mutex held: Hand out the next chunk to worker w.
+ * If its range is exhausted, steal the upper half of the largest
+ * remaining range (all of it if its owner has finished).
+ * Returns the length (0 if nothing left) and the start in *start. */
+static loff_t jobs_nextchunk(jobs_t *jb, worker_t *w, const unsigned int bs, loff_t *start)
+{
+	if (w->cur >= w->end) {
+		worker_t *victim = NULL;
+		loff_t best = 0, mid;
+		unsigned int i;
+		for (i = 0; i < jb->nwk; ++i) {
+			worker_t *v = jb->wk+i;
+			if (v->end - v->cur > best) {
+				best = v->end - v->cur;
+				victim = v;
+			}
+		}
+		if (!victim)
+			return 0;
+		if (victim->done)
+			mid = victim->cur;
+		else {
+			/* Not worth splitting */
+			if (best < 2*jb->chunk)
+				return 0;
+			mid = victim->cur + best/2;
+			mid -= mid % bs;
+		}
+		w->cur = mid; w->end = victim->end;
+		victim->end = mid;
+	}
+	*start = w->cur;
+	const loff_t len = MIN(jb->chunk, w->end - w->cur);
+	w->cur += len;
+	return len;
+}
+
+static void* jobs_worker(void *arg)
+{
+	worker_t *w = (worker_t*)arg;
+	jobs_t *jb = w->jobs;
+	opt_t *op = &w->op;
+	loff_t start, len;
+	while (1) {
+		pthread_mutex_lock(&jb->mutex);
+		len = (jb->stop || interrupted)? 0: jobs_nextchunk(jb, w, op->softbs, &start);
+		pthread_mutex_unlock(&jb->mutex);
+		if (!len)
+			break;
+		w->fst.ipos = start;
+		w->fst.opos = start + jb->odiff;
+		w->cend = start + len;
+		const loff_t old_xfer = w->prg.xfer;
+		if (op->softbs > op->hardbs)
+			w->errs += copyfile_softbs(old_xfer+len, op, &w->fst, &w->prg, &w->rep, jb->dop, jb->dst);
+		else
+			w->errs += copyfile_hardbs(old_xfer+len, op, &w->fst, &w->prg, &w->rep, jb->dop, jb->dst);
+		/* EOF earlier than expected or fatal write error:
+		 * Don't hand out anything beyond this point */
+		if (w->prg.xfer - old_xfer < len && !interrupted) {
+			const loff_t eofpos = start + w->prg.xfer - old_xfer;
+			unsigned int i;
+			pthread_mutex_lock(&jb->mutex);
+			if (eofpos < jb->eofpos)
+				jb->eofpos = eofpos;
+			for (i = 0; i < jb->nwk; ++i) {
+				worker_t *v = jb->wk+i;
+				if (v->end > eofpos)
+					v->end = MAX(v->cur, eofpos);
+			}
+			pthread_mutex_unlock(&jb->mutex);
+		}
+	}
+	pthread_mutex_lock(&jb->mutex);
+	w->done = 1;
+	pthread_mutex_unlock(&jb->mutex);
+	return NULL;
+}
+
+static int jobs_cmpbb(const void *a, const void *b)
+{
+	const loff_t la = *(const loff_t*)a, lb = *(const loff_t*)b;
+	return la < lb? -1: (la > lb? 1: 0);
+}
+
+/* Sum up the workers' progress into the main state */
+static char jobs_aggregate(jobs_t *jb, const progress_t *base, const int base_nrerr,
+			   fstate_t *fst, progress_t *prg)
+{
+	unsigned int i;
+	char alldone = 1;
+	prg->xfer = base->xfer; prg->sxfer = base->sxfer;
+	prg->fxfer = base->fxfer; prg->axfer = base->axfer;
+	fst->nrerr = base_nrerr;
+	for (i = 0; i < jb->nwk; ++i) {
+		worker_t *w = jb->wk+i;
+		prg->xfer += w->prg.xfer; prg->sxfer += w->prg.sxfer;
+		prg->fxfer += w->prg.fxfer; prg->axfer += w->prg.axfer;
+		fst->nrerr += w->fst.nrerr;
+		if (!w->done)
+			alldone = 0;
+	}
+	return alldone;
+}
+
+/* Parallel copy with op->jobs worker threads (-j): [ipos,fin_ipos[ is
+ * split into one range per worker, handed out in chunks; idle workers
+ * steal from the largest remaining range. The main thread aggregates
+ * progress, enforces maxerr and writes the sorted bad block list. */
+int copyfile_jobs(const loff_t max, opt_t *op, fstate_t *fst,
+		  progress_t *prg, repeat_t *rep,
+		  dpopt_t *dop, dpstate_t *dst)
+{
+	jobs_t jb;
+	unsigned int i, started = 0;
+	int errs = 0;
+	const loff_t start = fst->ipos;
+	const loff_t range = fst->fin_ipos - fst->ipos;
+	const progress_t base = *prg;
+	const int base_nrerr = fst->nrerr;
+	LISTTYPE(ofile_t) *of;
+	LISTFOREACH(ofiles, of) {
+		if (LISTDATA(of).cdev) {
+			fplog(stderr, WARN, "secondary output %s not seekable, no parallel copy\n",
+			      LISTDATA(of).name);
+			return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+		}
+	}
+	memset(&jb, 0, sizeof(jb));
+	jb.nwk = op->jobs;
+	jb.chunk = 16*(loff_t)op->softbs;
+	if (jb.chunk*jb.nwk > range)
+		jb.chunk = MAX(op->softbs, range/jb.nwk);
+	jb.odiff = fst->opos - fst->ipos;
+	jb.eofpos = fst->fin_ipos;
+	jb.dop = dop; jb.dst = dst;
+	pthread_mutex_init(&jb.mutex, NULL);
+	jb.wk = (worker_t*)calloc(jb.nwk, sizeof(worker_t));
+	if (!jb.wk) {
+		fplog(stderr, FATAL, "allocation of %i workers failed!\n", jb.nwk);
+		cleanup(1); exit(18);
+	}
+	loff_t per = range/jb.nwk;
+	per -= per % op->softbs;
+	for (i = 0; i < jb.nwk; ++i) {
+		worker_t *w = jb.wk+i;
+		w->jobs = &jb;
+		w->op = *op;
+		w->op.quiet = 1; w->op.verbose = 0;
+		w->op.maxerr = 0; w->op.syncfreq = 0;
+		w->op.worker = 1;
+		w->fst = *fst;
+		w->fst.nrerr = 0;
+		w->fst.buf = zalloc_aligned_buf(op->softbs, &w->fst.origbuf);
+		if (op->avoidwrite)
+			w->fst.buf2 = zalloc_aligned_buf(op->softbs, &w->fst.origbuf2);
+		w->cur = start + i*per;
+		w->end = (i == jb.nwk-1)? fst->fin_ipos: start + (i+1)*per;
+		/* Only running workers steal; unstarted ranges are free for all */
+		w->done = 1;
+	}
+	jobs = &jb;
+	for (i = 0; i < jb.nwk; ++i) {
+		worker_t *w = jb.wk+i;
+		pthread_mutex_lock(&jb.mutex);
+		w->done = 0;
+		pthread_mutex_unlock(&jb.mutex);
+		int err = pthread_create(&w->thread, NULL, jobs_worker, w);
+		if (err) {
+			pthread_mutex_lock(&jb.mutex);
+			w->done = 1;
+			pthread_mutex_unlock(&jb.mutex);
+			fplog(stderr, WARN, "could only start %i of %i workers: %s\n",
+			      started, jb.nwk, strerror(err));
+			break;
+		}
+		++started;
+	}
+	if (started)
+		fplog(stderr, INFO, "copying with %i parallel workers\n", started);
+	else
+		jb.eofpos = start;
+	while (started && !jobs_aggregate(&jb, &base, base_nrerr, fst, prg)) {
+		struct timespec ts = { 0, 50*1000*1000 };
+		nanosleep(&ts, NULL);
+		fst->ipos = start + prg->xfer - base.xfer;
+		fst->opos = fst->ipos + jb.odiff;
+		if (op->maxerr && fst->nrerr >= op->maxerr) {
+			pthread_mutex_lock(&jb.mutex);
+			jb.stop = 1;
+			pthread_mutex_unlock(&jb.mutex);
+		}
+		if (!op->quiet)
+			printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
+	}
+	for (i = 0; i < started; ++i)
+		pthread_join(jb.wk[i].thread, NULL);
+	jobs = NULL;
+	jobs_aggregate(&jb, &base, base_nrerr, fst, prg);
+	for (i = 0; i < jb.nwk; ++i) {
+		errs += jb.wk[i].errs;
+		ZFREE(jb.wk[i].fst.origbuf2);
+		ZFREE(jb.wk[i].fst.origbuf);
+	}
+	/* Copy done up to here; when stopped early, only up to the first
+	 * chunk that is not (completely) copied */
+	fst->ipos = jb.eofpos;
+	for (i = 0; (interrupted || jb.stop) && i < jb.nwk; ++i) {
+		const worker_t *w = jb.wk+i;
+		if (w->fst.ipos < w->cend)
+			fst->ipos = MIN(fst->ipos, w->fst.ipos);
+		if (w->cur < w->end)
+			fst->ipos = MIN(fst->ipos, w->cur);
+	}
+	fst->opos = fst->ipos + jb.odiff;
+	qsort(jb.bbs, jb.nbbs, sizeof(loff_t), jobs_cmpbb);
+	for (i = 0; i < jb.nbbs; ++i)
+		writebb(jb.bbs[i], op);
+	free(jb.bbs);
+	free(jb.wk);
+	pthread_mutex_destroy(&jb.mutex);
+	if (op->maxerr && fst->nrerr >= op->maxerr) {
+		fplog(stderr, FATAL, "maxerr reached!\n");
+		exit_report(32, op, fst, prg, dop);
+	}
+	/* Remainder (input may have grown), or all if no thread could be started */
+	if ((jb.eofpos == fst->fin_ipos || !started) && !interrupted)
+		errs += copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+	return errs;
+}
+#endif
+
+#ifdef FS_IOC_FIEMAP
+static int ext_cmp_phys(const void *a, const void *b)
+{
+	const struct fiemap_extent *e1 = (const struct fiemap_extent*)a;
+	const struct fiemap_extent *e2 = (const struct fiemap_extent*)b;
+	if (e1->fe_physical != e2->fe_physical)
+		return e1->fe_physical < e2->fe_physical? -1: 1;
+	return e1->fe_logical < e2->fe_logical? -1: e1->fe_logical > e2->fe_logical;
+}
+
+static int ext_cmp_log(const void *a, const void *b)
+{
+	const struct fiemap_extent *e1 = (const struct fiemap_extent*)a;
+	const struct fiemap_extent *e2 = (const struct fiemap_extent*)b;
+	return e1->fe_logical < e2->fe_logical? -1: e1->fe_logical > e2->fe_logical;
+}
+
+/* Copy [fst->ipos,end[ with parallel workers (-j) if worthwhile */
+static int ext_copy(const loff_t end, opt_t *op, fstate_t *fst,
+		    progress_t *prg, repeat_t *rep,
+		    dpopt_t *dop, dpstate_t *dst)
+{
+	const loff_t new_max = prg->xfer + end - fst->ipos;
+#ifdef USE_PTHREAD
+	if (op->jobs > 1 && end - fst->ipos >= 2*(loff_t)op->jobs*op->softbs) {
+		const loff_t fin = fst->fin_ipos;
+		int errs;
+		fst->fin_ipos = end;
+		errs = copyfile_jobs(new_max, op, fst, prg, rep, dop, dst);
+		fst->fin_ipos = fin;
+		return errs;
+	}
+#endif
+	if (op->softbs > op->hardbs)
+		return copyfile_softbs(new_max, op, fst, prg, rep, dop, dst);
+	else
+		return copyfile_hardbs(new_max, op, fst, prg, rep, dop, dst);
+}
+
+/* Account for the unallocated region [pos,end[ as skip_holes() does */
+static void ext_skip(loff_t pos, const loff_t end, const loff_t odiff,
+		     opt_t *op, fstate_t *fst, progress_t *prg)
+{
+	fst->ipos = pos; fst->opos = pos + odiff;
+	if (end > pos)
+		fplog(stderr, DEBUG, "skip hole @ ipos %lld (ln %lld)\n", pos, end - pos);
+	while (pos < end) {
+		const ssize_t sk = end - pos > 0x40000000? 0x40000000: end - pos;
+		sparse_skip(sk, op, fst, prg);
+		pos += sk;
+	}
+}
+
+/* Extent copy (-X): Only read the allocated and written extents of a
+ * regular input file (as reported by FIEMAP), sorted by their physical
+ * location to avoid seeks on rotating disks. Holes and unwritten
+ * (preallocated) extents are skipped like with -a. */
+int copyfile_extents(const loff_t max, opt_t *op, fstate_t *fst,
+		     progress_t *prg, repeat_t *rep,
+		     dpopt_t *dop, dpstate_t *dst)
+{
+	struct fiemap_extent *ext = NULL;
+	const loff_t odiff = fst->opos - fst->ipos;
+	const loff_t start = fst->ipos;
+	loff_t lim = fst->fin_ipos, alloc = 0, pos = start;
+	int i, n = 0, nx = 0, errs = 0;
+	if (max && start + max < lim)
+		lim = start + max;
+	if (lim > start)
+		n = get_mapping(fst->ides, start, lim - start, &ext);
+	if (n < 0) {
+		fplog(stderr, WARN, "extent map of %s not available: %s; linear copy\n",
+		      op->iname, strerror(-n));
+		return ext_copy(lim, op, fst, prg, rep, dop, dst);
+	}
+	/* Keep the written parts of extents within [start,lim[ */
+	for (i = 0; i < n; ++i) {
+		struct fiemap_extent e = ext[i];
+		if (e.fe_flags & FIEMAP_EXTENT_UNWRITTEN
+		    || e.fe_logical >= (uint64_t)lim
+		    || e.fe_logical + e.fe_length <= (uint64_t)start)
+			continue;
+		if (e.fe_logical < (uint64_t)start) {
+			const uint64_t d = start - e.fe_logical;
+			e.fe_logical += d; e.fe_physical += d; e.fe_length -= d;
+		}
+		if (e.fe_logical + e.fe_length > (uint64_t)lim)
+			e.fe_length = lim - e.fe_logical;
+		alloc += e.fe_length;
+		ext[nx++] = e;
+	}
+	if (!op->quiet)
+		fplog(stderr, INFO, "extents: %i with %skiB data of %skiB\n",
+		      nx, fmt_kiB(alloc, !nocol), fmt_kiB(lim - start, !nocol));
+	qsort(ext, nx, sizeof(*ext), ext_cmp_phys);
+	for (i = 0; i < nx && !interrupted; ++i) {
+		const loff_t xfer = prg->xfer;
+		fst->ipos = ext[i].fe_logical; fst->opos = fst->ipos + odiff;
+		errs += ext_copy(fst->ipos + ext[i].fe_length, op, fst, prg, rep, dop, dst);
+		/* EOF (file shrunk) or fatal error */
+		if (prg->xfer - xfer != (loff_t)ext[i].fe_length)
+			break;
+	}
+	/* Now account for the holes in between */
+	if (i == nx && !interrupted) {
+		qsort(ext, nx, sizeof(*ext), ext_cmp_log);
+		for (i = 0; i < nx; ++i) {
+			ext_skip(pos, ext[i].fe_logical, odiff, op, fst, prg);
+			pos = ext[i].fe_logical + ext[i].fe_length;
+		}
+		ext_skip(pos, lim, odiff, op, fst, prg);
+		fst->ipos = lim; fst->opos = lim + odiff;
+	}
+	free_mapping(0, ext);
+	return errs;
+}
+#endif
+
+#if defined(HAVE_OFFLOAD) || defined(HAVE_LINUX_IO_URING_H)
+/* Is the block range [off1,off2[ touched by an active fault injection?
+ * Unlike in_fault_list(), this does not consume the fault. */
+static int fault_overlap(LISTTYPE(fault_in_t) *faults, off_t off1, off_t off2)
+{
+	LISTTYPE(fault_in_t) *faultiter;
+	LISTFOREACH(faults, faultiter) {
+		fault_in_t *fault = &LISTDATA(faultiter);
+		if (fault->rep && off1 < fault->off2 && off2 > fault->off)
+			return 1;
+	}
+	return 0;
+}
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+/* Buffer slots for the io_uring engine,
+ * cycling FREE -> READ -> RDDONE [-> WRITE] -> FREE */
+enum ur_state { UR_FREE = 0, UR_READ, UR_RDDONE, UR_WRITE };
+typedef struct _ur_slot {
+	unsigned char *buf, *origbuf;
+	loff_t ipos, opos;
+	int toread, res;
+	enum ur_state state;
+} ur_slot_t;
+
+#define UR_WRFLAG 0x80000000U
+
+/* Completion of an async write: Failed or short writes are redone
+ * synchronously, so real_writeblock's retry logic and error
+ * accounting apply. Only now the block counts as transferred and
+ * is marked good in the map. Returns 0, 1 (error) or -1 (fatal error). */
+static int uring_wrdone(ur_slot_t *sl, opt_t *op, fstate_t *fst,
+			progress_t *prg, dpopt_t *dop)
+{
+	sl->state = UR_FREE;
+	prg->xfer += sl->toread;
+	if (sl->res == sl->toread) {
+		prg->sxfer += sl->res;
+		mapmark(sl->ipos, sl->toread, RMAP_GOOD, op);
+		return 0;
+	}
+	const loff_t old_opos = fst->opos;
+	const int done = sl->res > 0? sl->res: 0;
+	char retry = 0;
+	fst->opos = sl->opos + done;
+	ssize_t wr = real_writeblock(sl->buf+done, sl->toread-done, &retry, op, fst, prg, dop);
+	fst->opos = old_opos;
+	if (wr < 0) {
+		mapmark(sl->ipos, sl->toread, RMAP_UNTRIED, op);
+		if (is_writeerr_fatal(-wr, op)) {
+			fplog(stderr, FATAL, "write %s (%skiB): %s!\n",
+			      op->oname, fmt_kiB(sl->opos+done, !nocol), strerror(-wr));
+			return -1;
+		}
+		return 1;
+	}
+	prg->sxfer += done+wr;
+	mapmark(sl->ipos, sl->toread, RMAP_GOOD, op);
+	return 0;
+}
+
+/* Fetch all available completions. Returns no of errors or -1 if fatal. */
+static int uring_reap(uring_t *ring, ur_slot_t *slots, unsigned int *inflight,
+		      opt_t *op, fstate_t *fst, progress_t *prg, dpopt_t *dop)
+{
+	uint64_t udata;
+	int res, errs = 0, fatal = 0;
+	while (uring_get_cqe(ring, &udata, &res)) {
+		ur_slot_t *sl = slots + (udata & ~UR_WRFLAG);
+		--*inflight;
+		sl->res = res;
+		if (udata & UR_WRFLAG) {
+			int err = uring_wrdone(sl, op, fst, prg, dop);
+			if (err < 0)
+				fatal = 1;
+			else
+				errs += err;
+		} else
+			sl->state = UR_RDDONE;
+	}
+	return fatal? -1: errs;
+}
+
+/* Wait for all outstanding requests; pending reads are discarded.
+ * Returns no of (write) errors or -1 if fatal. */
+static int uring_drain(uring_t *ring, ur_slot_t *slots, const unsigned int qd,
+		       unsigned int *inflight,
+		       opt_t *op, fstate_t *fst, progress_t *prg, dpopt_t *dop)
+{
+	int errs = 0, fatal = 0;
+	unsigned int i;
+	while (*inflight) {
+		int rc = uring_submit(ring, 1);
+		if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+			fplog(stderr, FATAL, "io_uring wait failed: %s\n", strerror(-rc));
+			return -1;
+		}
+		rc = uring_reap(ring, slots, inflight, op, fst, prg, dop);
+		if (rc < 0)
+			fatal = 1;
+		else
+			errs += rc;
+	}
+	for (i = 0; i < qd; ++i)
+		slots[i].state = UR_FREE;
+	return fatal? -1: errs;
+}
+
+/* Copy with up to op->uring_qd softbs sized reads in flight via io_uring.
+ * Completed reads are processed strictly in order. If nothing needs to
+ * see the data on the way out (plugins, sparse detection, write avoidance,
+ * secondary outputs, write fault injection), the writes are submitted
+ * asynchronously as well; otherwise the usual dowrite_sparse() is used.
+ * Read errors and short reads (EOF) are handed to copyfile_softbs()
+ * for the affected block, so the normal fallback to hardbs applies,
+ * before we resume with the queued reads. Forward copies only. */
+int copyfile_uring(const loff_t max, opt_t *op, fstate_t *fst,
+		   progress_t *prg, repeat_t *rep,
+		   dpopt_t *dop, dpstate_t *dst)
+{
+	uring_t ring;
+	const unsigned int qd = op->uring_qd;
+	unsigned int i, head = 0, tail = 0, inflight = 0;
+	int errs = 0, fatal = 0, rc;
+	char more = 1, done = 0;
+	rc = uring_init(&ring, qd);
+	if (rc) {
+		fplog(stderr, WARN, "io_uring setup failed: %s, fall back to sync I/O\n",
+		      strerror(-rc));
+		return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+	}
+	ur_slot_t *slots = (ur_slot_t*)calloc(qd, sizeof(ur_slot_t));
+	if (!slots) {
+		fplog(stderr, FATAL, "allocation of %i io_uring slots failed!\n", qd);
+		cleanup(1); exit(18);
+	}
+	for (i = 0; i < qd; ++i)
+		slots[i].buf = zalloc_aligned_buf(op->softbs, &slots[i].origbuf);
+	const char async_wr = !plugins_opened && !op->sparse && !op->avoidwrite
+			      && !ofiles && !write_faults && !fst->o_chr;
+	unsigned char *const oldbuf = fst->buf;
+	/* Projected positions for the read submissions */
+	fstate_t pfst = *fst;
+	progress_t pprg = *prg;
+	/* expand file to AT LEAST the right length */
+	if (!fst->o_chr && !op->avoidwrite) {
+		rc = pwrite(fst->odes, fst->buf, 0, fst->opos);
+		if (rc)
+			fplog(stderr, WARN, "extending file %s to %skiB failed\n",
+			      op->oname, fmt_kiB(fst->opos, !nocol));
+	}
+	while (!fatal && !done) {
+		/* Queue reads into all free slots */
+		while (more && !interrupted && slots[tail].state == UR_FREE) {
+			ur_slot_t *sl = slots+tail;
+			int toread = blockxfer(max, op->softbs, op, &pfst, &pprg);
+			/* Don't queue reads beyond (known) EOF, copyfile_softbs does the rest */
+			if (fst->fin_ipos && pfst.ipos+toread > fst->fin_ipos)
+				toread = fst->fin_ipos-pfst.ipos;
+			if (toread <= 0) {
+				more = 0;
+				break;
 			}
-			errno = 0;
-			/* EOF ? */      
-			if (!err && prg->xfer == old_xfer)
-				return errs;
-			if (op->verbose) {
-				fprintf(stderr, DDR_DEBUG "ipos %skiB promote to large bs again! \n",
-					fmt_kiB(fst->ipos, !nocol));
-				scrollup = 0;
+			sl->toread = toread;
+			sl->opos = pfst.opos;
+			/* Leave injected faults to the synchronous code path */
+			if (read_faults && fault_overlap(read_faults, pfst.ipos/op->hardbs,
+							 (pfst.ipos+toread+op->hardbs-1)/op->hardbs)) {
+				sl->res = -EIO;
+				sl->state = UR_RDDONE;
+			} else {
+				tbucket_take(&rd_bucket, toread);
+				uring_prep_rw(&ring, IORING_OP_READ, fst->ides, sl->buf,
+					      toread, pfst.ipos, tail);
+				sl->state = UR_READ;
+				++inflight;
 			}
-		} else {
-			err = dowrite_sparse(rd, op, fst, prg, rep, dop);
-			if (err < 0)
-				return -err;
-			else
-				errs += err;
-		} /* errno */
-
-		errno = 0;
-		/* If we sync regularly, let's print a status update on each sync */
-		if (op->syncfreq && !(fst->ipos % (op->syncfreq*op->softbs)))
-			printstatus((op->quiet? 0: stderr), 0, op->softbs, 1, op, fst, prg, dop);
-		/* else print regularly acc. to updstat if not quiet */
-		else if (!op->quiet && !(fst->ipos % (2*updstat*op->softbs)))
-			printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
-		/* even if quiet, we need to call the printstatus if we do rate limiting */
-		else if (op->quiet && op->maxkbs && !(fst->ipos % (2*updstat*op->softbs)))
-			printstatus(0, 0, op->softbs, 0, op, fst, prg, dop);
-	} /* remain */
+			pfst.ipos += toread; pfst.opos += toread; pprg.xfer += toread;
+			tail = (tail+1)%qd;
+		}
+		if (!inflight && slots[head].state != UR_RDDONE)
+			break;
+		/* Submit and wait for a completion unless next block is ready */
+		rc = uring_submit(&ring, slots[head].state == UR_RDDONE? 0: 1);
+		if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+			fplog(stderr, FATAL, "io_uring submission failed: %s\n", strerror(-rc));
+			fatal = 1;
+			break;
+		}
+		rc = uring_reap(&ring, slots, &inflight, op, fst, prg, dop);
+		if (rc < 0) {
+			fatal = 1;
+			break;
+		}
+		errs += rc;
+		/* Process completed reads in order */
+		while (slots[head].state == UR_RDDONE) {
+			ur_slot_t *sl = slots+head;
+			if (sl->res < sl->toread) {
+				/* Read error or short read: Drain the ring and do this
+				 * block synchronously (with fallback to hardbs) */
+				const int toread = sl->toread;
+				rc = uring_drain(&ring, slots, qd, &inflight, op, fst, prg, dop);
+				if (rc < 0) {
+					fatal = 1;
+					break;
+				}
+				errs += rc;
+				const loff_t new_max = prg->xfer + toread;
+				if (op->verbose && sl->res < 0)
+					fplog(stderr, INFO, "problems at ipos %skiB: %s, retry sync\n",
+					      fmt_kiB(fst->ipos, !nocol), strerror(-sl->res));
+				errs += copyfile_softbs(new_max, op, fst, prg, rep, dop, dst);
+				/* EOF, fatal write error or interrupt */
+				if (prg->xfer != new_max || interrupted)
+					done = 1;
+				pfst = *fst; pprg = *prg;
+				head = 0; tail = 0;
+				break;
+			}
+			if (async_wr) {
+				tbucket_take(&wr_bucket, sl->toread);
+				uring_prep_rw(&ring, IORING_OP_WRITE, fst->odes, sl->buf,
+					      sl->toread, fst->opos, head | UR_WRFLAG);
+				sl->state = UR_WRITE;
+				++inflight;
+				/* Map and progress are updated on completion */
+				sl->ipos = fst->ipos;
+				fst->ipos += sl->toread; fst->opos += sl->toread;
+#ifdef HAVE_POSIX_FADVISE
+				if (op->evict)
+					evict_behind(op, fst);
+#endif
+			} else {
+				fst->buf = sl->buf;
+				rc = dowrite_sparse(sl->toread, op, fst, prg, rep, dop);
+				fst->buf = oldbuf;
+				sl->state = UR_FREE;
+				if (rc < 0) {
+					fatal = 1;
+					break;
+				}
+				errs += rc;
+			}
+			head = (head+1)%qd;
+
+			/* If we sync regularly, let's print a status update on each sync */
+			if (op->syncfreq && !(fst->ipos % (op->syncfreq*op->softbs)))
+				printstatus((op->quiet? 0: stderr), 0, op->softbs, 1, op, fst, prg, dop);
+			/* else print regularly acc. to updstat if not quiet */
+			else if (!op->quiet && !(fst->ipos % (2*updstat*op->softbs)))
+				printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
+		}
+	}
+	/* Outstanding writes still need to complete */
+	rc = uring_drain(&ring, slots, qd, &inflight, op, fst, prg, dop);
+	if (rc < 0)
+		fatal = 1;
+	else
+		errs += rc;
+	uring_exit(&ring);
+	for (i = 0; i < qd; ++i)
+		ZFREE(slots[i].origbuf);
+	free(slots);
+	if (fatal)
+		return 1;
+	/* Remainder (beyond estimated EOF) */
+	if (!done && !interrupted)
+		errs += copyfile_softbs(max, op, fst, prg, rep, dop, dst);
 	return errs;
 }
+#endif
 
 #ifdef HAVE_SPLICE
+/* Secondary output in splice mode, fed from its own pipe via tee() */
+typedef struct _teeout {
+	int pipe[2];
+	char failed;
+} teeout_t;
+
+#ifdef F_SETPIPE_SZ
+/* Try to make pipe hold bs bytes; returns its capacity */
+static int pipe_resize(const int fd, const int bs)
+{
+	int sz = fcntl(fd, F_SETPIPE_SZ, bs);
+	if (sz < 0)
+		sz = fcntl(fd, F_GETPIPE_SZ);
+	return sz > 0? sz: bs;
+}
+#endif
+
+/* Duplicate the rd bytes in pipe pin to secondary output of at opos.
+ * Returns 0 or an errno value. */
+static int tee_out(const int pin, teeout_t *to, ofile_t *of,
+		   ssize_t rd, loff_t opos)
+{
+	ssize_t tl = tee(pin, to->pipe[1], rd, 0);
+	if (tl < 0)
+		return errno;
+	/* Can't happen, all pipes have the same size */
+	if (tl != rd)
+		return EAGAIN;
+	while (rd) {
+		ssize_t wr = splice(to->pipe[0], NULL, of->fd, (of->cdev? NULL: &opos), rd,
+				    SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (wr <= 0)
+			return wr? errno: EIO;
+		rd -= wr;
+	}
+	return 0;
+}
+
+static void tee_close(teeout_t *tout, const unsigned int nout)
+{
+	unsigned int i;
+	for (i = 0; i < nout; ++i) {
+		if (tout[i].pipe[0] >= 0)
+			close(tout[i].pipe[0]);
+		if (tout[i].pipe[1] >= 0)
+			close(tout[i].pipe[1]);
+	}
+	free(tout);
+}
+
+/* Zerocopy (-k): The input is spliced into a pipe once; secondary
+ * outputs get a copy of the pipe contents with tee(), so the input
+ * is only read once. Failing secondary outputs are dropped. */
 int copyfile_splice(const loff_t max, opt_t *op, fstate_t *fst,
 		    progress_t *prg, repeat_t *rep, 
 		    dpopt_t *dop, dpstate_t *dst)
 
 {
 	ssize_t toread;
-	int fd_pipe[2];
+	int fd_pipe[2], bs = op->softbs, errs = 0;
+	const unsigned int nout = LISTSIZE(ofiles, ofile_t);
+	unsigned int i;
+	teeout_t *tout = NULL;
 	LISTTYPE(ofile_t) *oft;
 	if (pipe(fd_pipe) < 0)
 		return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
-	while ((toread	= blockxfer(max, op->softbs, op, fst, prg) && !interrupted) > 0) {
-		loff_t old_ipos = fst->ipos, old_opos = fst->opos;
+	if (nout) {
+		tout = (teeout_t*)malloc(nout*sizeof(teeout_t));
+		if (!tout) {
+			close(fd_pipe[0]); close(fd_pipe[1]);
+			return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+		}
+		for (i = 0; i < nout; ++i) {
+			tout[i].failed = 0;
+			tout[i].pipe[0] = tout[i].pipe[1] = -1;
+		}
+		for (i = 0; i < nout; ++i) {
+			if (pipe(tout[i].pipe) < 0) {
+				tout[i].pipe[0] = tout[i].pipe[1] = -1;
+				tee_close(tout, nout);
+				close(fd_pipe[0]); close(fd_pipe[1]);
+				return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+			}
+		}
+	}
+#ifdef F_SETPIPE_SZ
+	/* tee() only duplicates what fits, so give all pipes the same size */
+	bs = MIN(bs, pipe_resize(fd_pipe[1], bs));
+	for (i = 0; i < nout; ++i)
+		bs = MIN(bs, pipe_resize(tout[i].pipe[1], bs));
+	if (nout) {
+		pipe_resize(fd_pipe[1], bs);
+		for (i = 0; i < nout; ++i)
+			pipe_resize(tout[i].pipe[1], bs);
+	}
+#endif
+	while ((toread = blockxfer(max, bs, op, fst, prg)) > 0 && !interrupted) {
+		tbucket_take(&rd_bucket, toread);
+		tbucket_take(&wr_bucket, toread);
 		ssize_t rd = splice(fst->ides, &fst->ipos, fd_pipe[1], NULL, toread,
 					SPLICE_F_MOVE | SPLICE_F_MORE);
 		if (rd < 0) {
 			fplog(stderr, INFO, "%s (%skiB): fall back to userspace copy\n",
 			      op->iname, fmt_kiB(fst->ipos, !nocol));
 			close(fd_pipe[0]); close(fd_pipe[1]);
-			return copyfile_softbs(max, op, fst, prg, rep, dop, dst);
+			tee_close(tout, nout);
+			return errs + copyfile_softbs(max, op, fst, prg, rep, dop, dst);
 		}
 		if (rd == 0) {
 			fplog(stderr, INFO, "read %s (%skiB): EOF (splice)\n",
 			      op->iname, fmt_kiB(fst->ipos, !nocol));
 			break;
 		}
+		/* Feed secondary outputs before the data is moved out of the pipe */
+		i = 0;
+		LISTFOREACH(ofiles, oft) {
+			teeout_t *to = tout + i++;
+			int err;
+			if (to->failed)
+				continue;
+			err = tee_out(fd_pipe[0], to, &LISTDATA(oft), rd, fst->opos);
+			if (err) {
+				fplog(stderr, WARN, "write %s (%skiB): %s (splice), dropping output\n",
+				      LISTDATA(oft).name, fmt_kiB(fst->opos, !nocol), strerror(err));
+				/* Pipe may still hold data, don't reuse */
+				close(to->pipe[0]); close(to->pipe[1]);
+				to->pipe[0] = to->pipe[1] = -1;
+				to->failed = 1;
+				++errs;
+			}
+		}
 		while (rd) {
 			ssize_t wr = splice(fd_pipe[0], NULL, fst->odes, &fst->opos, rd,
 					SPLICE_F_MOVE | SPLICE_F_MORE);
@@ -2499,51 +5704,128 @@ int copyfile_splice(const loff_t max, opt_t *op, fstate_t *fst,
 					op->oname, fmt_kiB(fst->opos, !nocol), strerror(errno));
 
 				close(fd_pipe[0]); close(fd_pipe[1]);
+				tee_close(tout, nout);
 				exit_report(23, op, fst, prg, dop);
 			}
 			rd -= wr; prg->xfer += wr; prg->sxfer += wr;
 		}
-		loff_t new_ipos = fst->ipos, new_opos = fst->opos;
-		LISTFOREACH(ofiles, oft) {
-			fst->ipos = old_ipos; fst->opos = old_opos;
-			rd = splice(fst->ides, &fst->ipos, fd_pipe[1], NULL, toread,
-					SPLICE_F_MOVE | SPLICE_F_MORE);
-			/* Simplify error handling, it worked before ... */
-			if (rd <= 0) {
-				fplog(stderr, WARN, "Confused: splice() read failed unexpectedly: %s\n",
-					strerror(errno));
-				/* We should abort here .... */
-				fst->ipos = new_ipos; fst->opos = new_opos;
-				continue;
+		advancepos(0, 0, 0, op, fst, prg);
+		if (op->syncfreq && !(prg->xfer % (op->syncfreq*op->softbs)))
+			printstatus((op->quiet? 0: stderr), 0, op->softbs, 1, op, fst, prg, dop);
+		else if (!op->quiet && !(prg->xfer % (2*updstat*op->softbs)))
+			printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
+	}
+	close(fd_pipe[0]); close(fd_pipe[1]);
+	tee_close(tout, nout);
+	return errs;
+}
+#endif
+
+#ifdef HAVE_OFFLOAD
+#define OFFLOAD_CHUNK (16*1024*1024)
+
+/* Kernel offload copy (-H): Let the file system clone (reflink) or copy
+ * (copy_file_range) the data in chunks without passing it through user
+ * space. Chunks with read errors (or injected faults) are redone with
+ * the normal copy loop, so bad blocks are handled and logged as usual. */
+int copyfile_offload(const loff_t max, opt_t *op, fstate_t *fst,
+		     progress_t *prg, repeat_t *rep,
+		     dpopt_t *dop, dpstate_t *dst)
+{
+	int toread, errs = 0;
+	const int chunk = MAX(OFFLOAD_CHUNK - OFFLOAD_CHUNK % op->softbs, op->softbs);
+#ifdef FICLONERANGE
+	char clone = 1;
+#else
+	char clone = 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	char cfr = 1;
+#else
+	char cfr = 0;
+#endif
+#ifdef SEEK_DATA
+	holecache_t hc;
+	holecache_init(&hc, op, fst);
+#endif
+	while ((toread = blockxfer(max, chunk, op, fst, prg)) > 0 && !interrupted) {
+		ssize_t cp = -1;
+		int eno = 0;
+#ifdef SEEK_DATA
+		if (skip_holes(&hc, max, op, fst, prg))
+			continue;
+#endif
+		tbucket_take(&rd_bucket, toread);
+		tbucket_take(&wr_bucket, toread);
+		if ((read_faults && fault_overlap(read_faults, fst->ipos/op->hardbs,
+						  (fst->ipos+toread+op->hardbs-1)/op->hardbs))
+		    || (write_faults && fault_overlap(write_faults, fst->opos/op->hardbs,
+						      (fst->opos+toread+op->hardbs-1)/op->hardbs)))
+			eno = EIO;
+#ifdef FICLONERANGE
+		if (clone && !eno) {
+			struct file_clone_range fcr;
+			fcr.src_fd = fst->ides;
+			fcr.src_offset = fst->ipos;
+			fcr.src_length = toread;
+			fcr.dest_offset = fst->opos;
+			if (!ioctl(fst->odes, FICLONERANGE, &fcr))
+				cp = toread;
+			else if (errno == EIO)
+				eno = EIO;
+			else {
+				fplog(stderr, DEBUG, "reflink %s -> %s: %s\n",
+				      op->iname, op->oname, strerror(errno));
+				clone = 0;
 			}
-			while (rd) {
-				ssize_t wr = splice(fd_pipe[0], NULL, LISTDATA(oft).fd, &fst->opos, rd,
-						SPLICE_F_MOVE | SPLICE_F_MORE);
-				if (wr < 0) {	
-					fplog(stderr, WARN, "Confused: splice() write failed unexpectedly: %s\n",
-						strerror(errno));
-					/* We should abort here .... */
-					fst->ipos = new_ipos; fst->opos = new_opos;
-					continue;
+		}
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+		if (cfr && cp < 0 && !eno) {
+			loff_t ipos = fst->ipos, opos = fst->opos;
+			cp = copy_file_range(fst->ides, &ipos, fst->odes, &opos, toread, 0);
+			if (cp < 0) {
+				if (errno == EIO)
+					eno = EIO;
+				else {
+					fplog(stderr, DEBUG, "copy_file_range %s -> %s: %s\n",
+					      op->iname, op->oname, strerror(errno));
+					cfr = 0;
 				}
-			rd -= wr;
 			}
 		}
-		if (fst->ipos != new_ipos || fst->opos != new_opos) {
-			fplog(stderr, WARN, "Confused: splice progress inconsistent: %zi %zi %zi %zi\n",
-				fst->ipos, new_ipos, fst->opos, new_opos);
-			fst->ipos = new_ipos; fst->opos = new_opos;
-		}	
-		advancepos(0, 0, 0, op, fst, prg);
+#endif
+		errno = 0;
+		if (cp == 0) {
+			fplog(stderr, INFO, "read %s (%skiB): EOF (offload)\n",
+			      op->iname, fmt_kiB(fst->ipos, !nocol));
+			break;
+		}
+		if (cp < 0 && !eno) {
+			fplog(stderr, INFO, "%s (%skiB): fall back to userspace copy\n",
+			      op->iname, fmt_kiB(fst->ipos, !nocol));
+			return errs + (op->softbs > op->hardbs?
+				copyfile_softbs(max, op, fst, prg, rep, dop, dst):
+				copyfile_hardbs(max, op, fst, prg, rep, dop, dst));
+		}
+		if (cp < 0) {
+			/* Let the normal copy loop handle this chunk */
+			const loff_t new_max = prg->xfer + toread;
+			if (op->softbs > op->hardbs)
+				errs += copyfile_softbs(new_max, op, fst, prg, rep, dop, dst);
+			else
+				errs += copyfile_hardbs(new_max, op, fst, prg, rep, dop, dst);
+			/* EOF or fatal error */
+			if (prg->xfer != new_max)
+				break;
+		} else
+			advancepos(cp, cp, cp, op, fst, prg);
 		if (op->syncfreq && !(prg->xfer % (op->syncfreq*op->softbs)))
 			printstatus((op->quiet? 0: stderr), 0, op->softbs, 1, op, fst, prg, dop);
-		else if (!op->quiet && !(prg->xfer % (2*updstat*op->softbs)))
+		else if (!op->quiet)
 			printstatus(stderr, 0, op->softbs, 0, op, fst, prg, dop);
-		else if (op->quiet && op->maxkbs && !(prg->xfer % (2*updstat*op->softbs)))
-			printstatus(0, 0, op->softbs, 0, op, fst, prg, dop);
 	}
-	close(fd_pipe[0]); close(fd_pipe[1]);
-	return 0;
+	return errs;
 }
 #endif
 
@@ -2556,15 +5838,13 @@ int tripleoverwrite(const loff_t max, opt_t *op, fstate_t *fst,
 	void* prng_state3 = frandom_stdup(dst->prng_state);
 	clock_t orig_startclock = startclock;
 	struct timeval orig_starttime;
-	LISTTYPE(ofile_t) *of;
 	memcpy(&orig_starttime, &starttime, sizeof(starttime));
 	//fprintf(stderr, "%s%s%s%s" DDR_INFO "Triple overwrite (BSI M7.15): first pass ... (frandom)      \n\n\n\n\n", up, up, up, up);
 	fprintf(stderr, DDR_INFO "Triple overwrite (BSI M7.15): first pass ... (frandom)      \n");
 	ret += copyfile_softbs(max, op, fst, prg, rep, dop, dst);
 	fprintf(stderr, "syncing ... \n%s", up);
 	ret += fsync(fst->odes);
-	LISTFOREACH(ofiles, of)
-		fsync(LISTDATA(of).fd);
+	sync_ofiles();
 	/* TODO: better error handling */
 	frandom_release(dst->prng_state);
 	dst->prng_state = prng_state3; prng_state3 = 0;
@@ -2576,8 +5856,7 @@ int tripleoverwrite(const loff_t max, opt_t *op, fstate_t *fst,
 		ret += copyfile_softbs(max, op, fst, prg, rep, dop, dst);
 		fprintf(stderr, "syncing ... \n%s", up);
 		ret += fsync(fst->odes);
-		LISTFOREACH(ofiles, of)
-			fsync(LISTDATA(of).fd);
+		sync_ofiles();
 		/* TODO: better error handling */
 		dop->bsim715_2ndpass = 0;
 		if (dop->bsim715_4) {
@@ -2588,8 +5867,7 @@ int tripleoverwrite(const loff_t max, opt_t *op, fstate_t *fst,
 			ret += copyfile_softbs(max, op, fst, prg, rep, dop, dst);
 			fprintf(stderr, "syncing ... \n%s", up);
 			ret += fsync(fst->odes);
-			LISTFOREACH(ofiles, of)
-				fsync(LISTDATA(of).fd);
+			sync_ofiles();
 			dop->bsim715_2ndpass = 1;
 			op->iname = "FRND+invFRND+FRND2+ZERO";
 		} else
@@ -2634,6 +5912,59 @@ static loff_t readint(const char* const ptr, const char* delim)
 	return (loff_t)res;
 }
 
+/* -C rdrate[:wrrate[:burst]], wrrate defaults to rdrate */
+static void readrate(const char* arg, opt_t *op)
+{
+	const char *col = strchr(arg, ':');
+	op->maxkbs = (unsigned int)(readint(arg, ":")/1024);
+	op->maxwrkbs = col? (unsigned int)(readint(col+1, ":")/1024): op->maxkbs;
+	if (col && (col = strchr(col+1, ':')))
+		op->rateburst = (unsigned int)(readint(col+1, 0)/1024);
+}
+
+/* -g class[:level], class being idle, be, rt or 1-3 */
+static int readioprio(const char* arg)
+{
+	int cls, lvl = 4;
+	const char *col = strchr(arg, ':');
+	if (!strncasecmp(arg, "rt", 2))
+		cls = 1;
+	else if (!strncasecmp(arg, "be", 2))
+		cls = 2;
+	else if (!strncasecmp(arg, "idle", 4))
+		cls = 3;
+	else
+		cls = atoi(arg);
+	if (col)
+		lvl = atoi(col+1);
+	if (cls < 1 || cls > 3 || lvl < 0 || lvl > 7) {
+		fplog(stderr, FATAL, "invalid I/O priority %s (idle, be[:0-7], rt[:0-7])\n", arg);
+		cleanup(1); exit(11);
+	}
+	/* idle has no levels */
+	return cls << IOPRIO_CLASS_SHIFT | (cls == 3? 0: lvl);
+}
+
+/* -8 nowait[,hipri] */
+static char readrwflags(const char* arg)
+{
+	char mode = 0;
+	while (*arg) {
+		const char *com = strchr(arg, ',');
+		const size_t ln = com? (size_t)(com-arg): strlen(arg);
+		if (ln == 6 && !strncasecmp(arg, "nowait", 6))
+			mode |= RWF_MODE_NOWAIT;
+		else if (ln == 5 && !strncasecmp(arg, "hipri", 5))
+			mode |= RWF_MODE_HIPRI;
+		else {
+			fplog(stderr, FATAL, "invalid I/O flags %s (nowait, hipri)\n", arg);
+			cleanup(1); exit(11);
+		}
+		arg += ln + !!com;
+	}
+	return mode;
+}
+
 char readbool(const char* arg)
 {
 	if (isdigit(*arg))
@@ -2708,6 +6039,9 @@ void printversion()
 #ifdef HAVE_SPLICE
 	fprintf(stderr, "splice ");
 #endif
+#ifdef HAVE_LINUX_IO_URING_H
+	fprintf(stderr, "io_uring ");
+#endif
 #ifdef FITRIM
 	fprintf(stderr, "fitrim ");
 #endif
@@ -2763,7 +6097,16 @@ struct option longopts[] = { 	{"help", 0, NULL, 'h'}, {"verbose", 0, NULL, 'v'},
  				{"shred3", 1, NULL, '3'}, {"shred4", 1, NULL, '4'},
  				{"shred2", 1, NULL, '2'},
 				{"rmvtrim", 0, NULL, 'u'}, {"plugins", 1, NULL, 'L'},
-				{"fault", 1, NULL, 'F'},
+				{"fault", 1, NULL, 'F'}, {"uring", 1, NULL, 'U'},
+				{"pipeline", 1, NULL, 'Q'}, {"jobs", 1, NULL, 'j'},
+				{"mapfile", 1, NULL, 'O'}, {"resume", 0, NULL, 'K'},
+				{"multipass", 0, NULL, 'N'}, {"revscrape", 0, NULL, 'J'},
+				{"adaptive", 0, NULL, 'G'}, {"extents", 0, NULL, 'X'},
+				{"offload", 0, NULL, 'H'}, {"mmap", 0, NULL, 'I'},
+				{"buffered", 0, NULL, 'n'}, {"ioprio", 1, NULL, 'g'},
+				{"latmap", 1, NULL, '5'}, {"deadline", 1, NULL, '6'},
+				{"sgio", 1, NULL, '7'}, {"rwflags", 1, NULL, '8'},
+				{"revahead", 1, NULL, '9'}, {"evict", 1, NULL, '0'},
 				/* GNU ddrescue compat */
 				{"block-size", 1, NULL, 'B'}, {"input-position", 1, NULL, 's'},
 				{"output-position", 1, NULL, 'S'}, {"max-size", 1, NULL, 'm'},
@@ -2785,24 +6128,57 @@ void printlonghelp()
 	fprintf(stderr, "         -S opos    start position in output file (def=ipos),\n");
 	fprintf(stderr, "         -b softbs  block size for copy operation (def=%i, %i for -d),\n", BUF_SOFTBLOCKSIZE, DIO_SOFTBLOCKSIZE);
 	fprintf(stderr, "         -B hardbs  fallback block size in case of errs (def=%i, %i for -d),\n", BUF_HARDBLOCKSIZE, DIO_HARDBLOCKSIZE);
+	fprintf(stderr, "         -G         adapt block size (up to softbs) to throughput and errors,\n");
 	fprintf(stderr, "         -e maxerr  exit after maxerr errors (def=0=infinite),\n");
+#ifdef USE_PTHREAD
+	fprintf(stderr, "         -6 secs    give up on reads that take longer than secs (def=0=wait),\n");
+#endif
 	fprintf(stderr, "         -m maxxfer maximum amount of data to be transfered (def=0=inf),\n");
 	fprintf(stderr,	"         -M         avoid extending outfile,\n");
 	fprintf(stderr,	"         -x         count opos from the end of outfile (eXtend),\n");
-	fprintf(stderr, "         -y syncsz  frequency of fsync calls in bytes (def=512*softbs),\n");
+	fprintf(stderr, "         -y syncsz  frequency of fsync (or write-behind) calls in bytes (def=0=end),\n");
+#ifdef HAVE_POSIX_FADVISE
+	fprintf(stderr, "         -0 size    drop copied data from the page cache every size bytes (def=0=end),\n");
+#endif
 	fprintf(stderr, "         -l logfile name of a file to log errors and summary to (def=\"\"),\n");
 	fprintf(stderr, "         -o bbfile  name of a file to log bad blocks numbers (def=\"\"),\n");
+	fprintf(stderr, "         -O mapfile name of a file to track good/bad regions in (def=\"\"),\n");
+	fprintf(stderr, "         -5 latfile name of a CSV file for read latencies per region (def=\"\"),\n");
+	fprintf(stderr, "         -K         resume: only copy regions not marked good in mapfile,\n");
+	fprintf(stderr, "         -N         multipass: copy skipping bad areas, then trim and scrape them,\n");
+	fprintf(stderr, "         -J         scrape backwards in the last pass of -N,\n");
 	fprintf(stderr, "         -r         reverse direction copy (def=forward),\n");
+#ifdef HAVE_POSIX_FADVISE
+	fprintf(stderr, "         -9 size    read ahead size for reverse copies (def=8*softbs),\n");
+#endif
 	fprintf(stderr, "         -R         repeatedly write same block (def if infile is /dev/zero),\n");
 	fprintf(stderr, "         -t         truncate output file at start (def=no),\n");
 	fprintf(stderr, "         -T         truncate output file at last pos (def=no),\n");
 	fprintf(stderr, "         -u         undo writes by deleting outfile and issueing fstrim\n");
 #ifdef O_DIRECT
-	fprintf(stderr, "         -d/D       use O_DIRECT for input/output (def=no),\n");
+	fprintf(stderr, "         -d/D       use O_DIRECT for input/output (def=block devices only),\n");
+	fprintf(stderr, "         -n         don't use O_DIRECT for block devices by default,\n");
 #endif
 #ifdef HAVE_SPLICE
 	fprintf(stderr, "         -k         use efficient in-kernel zerocopy splice,\n");
 #endif       	
+#ifdef HAVE_OFFLOAD
+	fprintf(stderr, "         -H         hand off file copy to kernel (reflink, copy_file_range),\n");
+#endif
+	fprintf(stderr, "         -I         read input via mmap instead of copying it (def=no),\n");
+#ifdef HAVE_RWF
+	fprintf(stderr, "         -8 flags   preadv2/pwritev2 flags: nowait (page cache first), hipri (poll),\n");
+#endif
+#ifdef HAVE_SCSI_SG_H
+	fprintf(stderr, "         -7 secs    read SCSI/SATA input via SG_IO, no kernel retries, timeout secs,\n");
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+	fprintf(stderr, "         -U qdepth  use io_uring with qdepth blocks in flight (def=0=off),\n");
+#endif
+#ifdef USE_PTHREAD
+	fprintf(stderr, "         -Q nbufs   read ahead in a separate thread into nbufs buffers (def=0=off),\n");
+	fprintf(stderr, "         -j jobs    copy with jobs parallel worker threads (def=1),\n");
+#endif
 #if defined(HAVE_FALLOCATE64) || defined(HAVE_LIBFALLOCATE)
 	fprintf(stderr, "         -P         use fallocate to preallocate target space,\n");
 #endif
@@ -2813,10 +6189,14 @@ void printlonghelp()
 	fprintf(stderr, "         -W         read target block and avoid Writes if identical (def=no),\n");
 	fprintf(stderr, "         -a         detect zero-filled blocks and write spArsely (def=no),\n");
 	fprintf(stderr, "         -A         Always write blocks, zeroed if err (def=no),\n");
+#ifdef FS_IOC_FIEMAP
+	fprintf(stderr, "         -X         only copy allocated eXtents of infile, in physical order (def=no),\n");
+#endif
 	fprintf(stderr, "         -i         interactive: ask before overwriting data (def=no),\n");
 	fprintf(stderr, "         -f         force: skip some sanity checks (def=no),\n");
 	fprintf(stderr, "         -p         preserve: preserve ownership, perms, times, attrs (def=no),\n");
-	fprintf(stderr, "         -C limit   rateControl: avoid xfer data faster than limit B/s\n");
+	fprintf(stderr, "         -C rd[:wr[:burst]] rateControl: limit reads/writes to rd/wr B/s,\n");
+	fprintf(stderr, "         -g cls[:lv] I/O priority class idle, be or rt, level 0-7 (def=unchanged),\n");
 	fprintf(stderr, "         -Y oname   Secondary output file (multiple possible),\n");
 	fprintf(stderr, "         -F off[-off]r/rep[,off[-off]w/rep[,...]]  fault injection (hardbs off) r/w\n");
 	fprintf(stderr, "         -q         quiet operation,\n");
@@ -2853,7 +6233,8 @@ void printinfo(FILE* const file, opt_t *op)
 {
 	fplog(file, DEBUG, "transfer max %s kiBytes from %s to %s\n",
 	      (op->maxxfer? fmt_kiB(op->maxxfer, !op->nocol): "unlim"), op->iname, op->oname);
-	fplog(file, DEBUG, "blocksizes: soft %i, hard %i\n", op->softbs, op->hardbs);
+	fplog(file, DEBUG, "blocksizes: soft %i%s, hard %i\n", op->softbs,
+	      (op->adaptive? " (max, adaptive)": ""), op->hardbs);
 	fplog(file, DEBUG, "starting positions: in %skiB, out %skiB\n",
 	      fmt_kiB(op->init_ipos, !nocol), fmt_kiB(op->init_opos, !nocol));
 	fplog(file, DEBUG, "Logfile: %s, Maxerr: %li\n",
@@ -2862,10 +6243,26 @@ void printinfo(FILE* const file, opt_t *op)
 	      YESNO(op->reverse), (op->dotrunc? "yes": (op->trunclast? "last": "no")), YESNO(op->interact));
 	fplog(file, DEBUG, "abort on Write errs: %s, spArse write: %s\n",
 	      YESNO(op->abwrerr), (op->sparse? "yes": (op->nosparse? "never": "if err")));
-	fplog(file, DEBUG, "preserve: %s, splice: %s, avoidWrite: %s\n",
-	      YESNO(op->preserve), YESNO(op->dosplice), YESNO(op->avoidwrite));
-	fplog(file, DEBUG, "fallocate: %s, Repeat: %s, O_DIRECT: %s/%s\n",
-	      YESNO(op->falloc), YESNO(op->i_repeat), YESNO(op->o_dir_in), YESNO(op->o_dir_out));
+	fplog(file, DEBUG, "preserve: %s, splice: %s, offload: %s, mmap: %s, avoidWrite: %s\n",
+	      YESNO(op->preserve), YESNO(op->dosplice), YESNO(op->offload), YESNO(op->mmapin),
+	      YESNO(op->avoidwrite));
+	fplog(file, DEBUG, "fallocate: %s, Repeat: %s, O_DIRECT: %s/%s%s\n",
+	      YESNO(op->falloc), YESNO(op->i_repeat), YESNO(op->o_dir_in), YESNO(op->o_dir_out),
+	      (op->buffered? " (not for blkdevs)": ""));
+	fplog(file, DEBUG, "io_uring queue depth: %i, read-ahead buffers: %i, jobs: %i\n",
+	      op->uring_qd, op->pipe_bufs, op->jobs);
+	fplog(file, DEBUG, "rate limit: %ikiB/s read, %ikiB/s write (0=unlim), burst %ikiB (0=1/8s), ioprio: %i/%i\n",
+	      op->maxkbs, op->maxwrkbs, op->rateburst,
+	      op->ioprio >> IOPRIO_CLASS_SHIFT, op->ioprio & 7);
+	fplog(file, DEBUG, "Latency file: %s, read deadline: %.3fs, SG_IO timeout: %.3fs\n",
+	      (op->latname? op->latname: "(none)"), op->deadline/1000.0, op->sgio_tmo/1000.0);
+	fplog(file, DEBUG, "RWF_NOWAIT reads: %s, polled (RWF_HIPRI) O_DIRECT: %s, reverse readahead: %skiB\n",
+	      YESNO(op->rwflags & RWF_MODE_NOWAIT), YESNO(op->rwflags & RWF_MODE_HIPRI),
+	      fmt_kiB(MAX(op->revahead, 0), !nocol));
+	fplog(file, DEBUG, "page cache eviction window: %skiB (0=at end)\n", fmt_kiB(op->evict, !nocol));
+	fplog(file, DEBUG, "Mapfile: %s, resume: %s, multipass: %s, extents: %s\n",
+	      (op->mapname? op->mapname: "(none)"), YESNO(op->resume),
+	      (op->multipass? (op->revscrape? "rev scrape": "yes"): "no"), YESNO(op->extents));
 	/*
 	fplog(file, DEBUG, "verbose: %s, quiet: %s\n", 
 	      YESNO(op->verbose), YESNO(op->quiet));
@@ -2888,6 +6285,11 @@ void breakhandler(int sig)
 	}
 }
 
+void latdumphandler(int sig)
+{
+	lat_dumpreq = 1;
+}
+
 unsigned char* zalloc_aligned_buf(unsigned int bs, unsigned char**obuf)
 {
 	unsigned char *ptr = 0;
@@ -3008,6 +6410,7 @@ void populate_faultlists(const char* arg, opt_t *op)
 		fault_in_t fault;
 		fault.off = 0L;
 		fault.off2 = 0L;
+		fault.delay = 1000;
 		int err = sscanf(arg, "%lu%c/%i", (unsigned long*)&fault.off, &rw, &fault.rep);
 		if (err != 3) {
 			int err = sscanf(arg, "%lu-%lu%c/%i", (unsigned long*)&fault.off, 
@@ -3020,12 +6423,17 @@ void populate_faultlists(const char* arg, opt_t *op)
 			fault.off2 = fault.off+1;
 		if (fault.rep == 0)
 			fault.rep = INT_MAX;
+		const char* col = strchr(arg, ':');
+		if (col && (!ptr || col < ptr))
+			fault.delay = atoi(col+1);
 		if (rw == 'r')
 			LISTAPPEND(read_faults, fault, fault_in_t);
 		else if (rw == 'w')
 			LISTAPPEND(write_faults, fault, fault_in_t);
+		else if (rw == 'l')
+			LISTAPPEND(slow_faults, fault, fault_in_t);
 		else {
-			fplog(stderr, FATAL, "Need to specify r or w for X in offX/rep in %s\n", arg);
+			fplog(stderr, FATAL, "Need to specify r, w or l for X in offX/rep in %s\n", arg);
 			cleanup(1); exit(11);
 		}
 		if (ptr)
@@ -3035,8 +6443,9 @@ void populate_faultlists(const char* arg, opt_t *op)
 		fplog(stderr, DEBUG, "Inject %c fault (%ix) for range %" LL "u-%" LL "u\n",
 			rw, fault.rep, fault.off, fault.off2);
 	}
-	fplog(stderr, DEBUG, "Will inject %i/%i faults for read/write\n",
-		LISTSIZE(read_faults, fault_in_t), LISTSIZE(write_faults, fault_in_t));
+	fplog(stderr, DEBUG, "Will inject %i/%i/%i faults for read/write/latency\n",
+		LISTSIZE(read_faults, fault_in_t), LISTSIZE(write_faults, fault_in_t),
+		LISTSIZE(slow_faults, fault_in_t));
 }
 
 
@@ -3052,6 +6461,7 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 
 	op->init_ipos = (loff_t)-INT_MAX; 
 	op->init_opos = (loff_t)-INT_MAX; 
+	op->revahead = -1;
 
 	op->nocol = test_nocolor_term();
 	nocol = op->nocol;
@@ -3069,9 +6479,9 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 	int tmpfd = 0;
 
 #ifdef LACK_GETOPT_LONG
-	while ((c = getopt(argc, argv, ":rtTfihqvVwWaAdDkMRpPuc:b:B:m:e:s:S:l:L:o:y:z:Z:2:3:4:xY:F:C:E:")) != -1)
+	while ((c = getopt(argc, argv, ":rtTfihqvVwWaAdDkMRpPuc:b:B:m:e:s:S:l:L:o:y:z:Z:2:3:4:xY:F:C:E:U:Q:j:O:KNJGXHIng:5:6:7:8:9:0:")) != -1)
 #else
-	while ((c = getopt_long(argc, argv, ":rtTfihqvVwWaAdDkMRpPuc:b:B:m:e:s:S:l:L:o:y:z:Z:2:3:4:xY:F:C:E:", longopts, NULL)) != -1)
+	while ((c = getopt_long(argc, argv, ":rtTfihqvVwWaAdDkMRpPuc:b:B:m:e:s:S:l:L:o:y:z:Z:2:3:4:xY:F:C:E:U:Q:j:O:KNJGXHIng:5:6:7:8:9:0:", longopts, NULL)) != -1)
 #endif
 	{
 		switch (c) {
@@ -3084,6 +6494,7 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 #ifdef O_DIRECT
 			case 'd': op->o_dir_in  = O_DIRECT; break;
 			case 'D': op->o_dir_out = O_DIRECT; break;
+			case 'n': op->buffered = 1; break;
 #endif
 #ifdef HAVE_SPLICE
 			case 'k': op->dosplice = 1; break;
@@ -3101,7 +6512,14 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 				  if (ddr_loglevel >= 3) ddr_loglevel = 5; else ddr_loglevel = 3; break;
 			case 'E': ddr_loglevel = readint(optarg, 0); break;
 			case 'c': op->nocol = !readbool(optarg); nocol = op->nocol; break;
-			case 'C': op->maxkbs = (unsigned int)(readint(optarg, 0)/1024); break;
+			case 'C': readrate(optarg, op); break;
+			case 'g': op->ioprio = readioprio(optarg); break;
+			case '5': op->latname = optarg; break;
+			case '6': op->deadline = (unsigned int)(strtod(optarg, NULL)*1000); break;
+			case '7': op->sgio_tmo = (unsigned int)(strtod(optarg, NULL)*1000); break;
+			case '8': op->rwflags = readrwflags(optarg); break;
+			case '9': op->revahead = readint(optarg, 0); break;
+			case '0': op->evict = readint(optarg, 0); break;
 			case 'b': op->softbs = (int)readint(optarg, 0); break;
 			case 'B': op->hardbs = (int)readint(optarg, 0); break;
 			case 'm': op->maxxfer = readint(optarg, 0); break;
@@ -3119,6 +6537,17 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 			case 'x': op->extend = 1; break;
 			case 'u': op->rmvtrim = 1; break;
 			case 'F': populate_faultlists(optarg, op); break;
+			case 'U': op->uring_qd = (unsigned int)readint(optarg, 0); break;
+			case 'Q': op->pipe_bufs = (unsigned int)readint(optarg, 0); break;
+			case 'j': op->jobs = (unsigned int)readint(optarg, 0); break;
+			case 'O': op->mapname = optarg; break;
+			case 'K': op->resume = 1; break;
+			case 'N': op->multipass = 1; break;
+			case 'J': op->revscrape = 1; break;
+			case 'G': op->adaptive = 1; break;
+			case 'X': op->extents = 1; break;
+			case 'H': op->offload = 1; break;
+			case 'I': op->mmapin = 1; break;
 			case 'Y': do { ofile_t of; of.name = optarg; of.fd = -1; of.cdev = 0; LISTAPPEND(ofiles, of, ofile_t); } while (0); break;
 			case 'z': dop->prng_libc = 1; if (is_filename(optarg)) dop->prng_sfile = optarg; else dop->prng_seed = readint(optarg, 0); break;
 			case 'Z': dop->prng_frnd = 1; if (is_filename(optarg)) dop->prng_sfile = optarg; else dop->prng_seed = readint(optarg, 0); break;
@@ -3176,10 +6605,6 @@ char* parse_opts(int argc, char* argv[], opt_t *op, dpopt_t *dop)
 		fplog(stderr, WARN, "O_DIRECT requires hardbs of at least %i!\n",
 		      op->hardbs);
 	}
-
-	if (op->o_dir_in || op->o_dir_out)
-		fplog(stderr, WARN, "We don't handle misalignment of last block w/ O_DIRECT!\n");
-				
 #endif
 
 	if (op->softbs < op->hardbs) {
@@ -3215,6 +6640,16 @@ void sanitize_and_prepare(opt_t *op, dpopt_t *dop, fstate_t *fst, dpstate_t *dst
 	if (op->init_ipos == (loff_t)-INT_MAX)
 		op->init_ipos = 0;
 
+	if (op->ioprio) {
+#ifdef SYS_ioprio_set
+		/* IOPRIO_WHO_PROCESS, 0 = this process (all threads created later) */
+		if (syscall(SYS_ioprio_set, 1, 0, op->ioprio))
+			fplog(stderr, WARN, "setting I/O priority failed: %s\n", strerror(errno));
+#else
+		fplog(stderr, WARN, "no ioprio_set support, ignoring -g\n");
+#endif
+	}
+
 	if (op->dosplice && op->avoidwrite) {
 		fplog(stderr, WARN, "disable write avoidance (-W) for splice copy\n");
 		op->avoidwrite = 0;
@@ -3409,11 +6844,86 @@ void sanitize_and_prepare(opt_t *op, dpopt_t *dop, fstate_t *fst, dpstate_t *dst
 		cleanup(1); exit(19);
 	}
 		
+	if (op->mapname) {
+		if (fst->i_chr || op->i_repeat) {
+			fplog(stderr, WARN, "map file needs seekable input, ignoring -O\n");
+			op->mapname = 0;
+		} else if (op->dosplice) {
+			fplog(stderr, INFO, "map file not supported with splice, disabling -k\n");
+			op->dosplice = 0;
+		}
+	}
+	if (op->multipass) {
+		if (fst->i_chr || op->i_repeat || op->reverse) {
+			fplog(stderr, WARN, "multipass needs forward copy from seekable input, ignoring -N\n");
+			op->multipass = 0;
+		} else {
+			if (op->dosplice) {
+				fplog(stderr, INFO, "multipass not supported with splice, disabling -k\n");
+				op->dosplice = 0;
+			}
+			if (op->uring_qd || op->pipe_bufs || op->jobs > 1) {
+				fplog(stderr, INFO, "multipass: ignoring -U, -Q, -j\n");
+				op->uring_qd = 0; op->pipe_bufs = 0; op->jobs = 0;
+			}
+		}
+	}
+	if (op->resume) {
+		if (!op->mapname) {
+			fplog(stderr, FATAL, "resume (-K) needs a map file (-O)\n");
+			cleanup(1); exit(12);
+		}
+		if (op->uring_qd || op->pipe_bufs || op->jobs > 1) {
+			fplog(stderr, INFO, "resume: ignoring -U, -Q, -j\n");
+			op->uring_qd = 0; op->pipe_bufs = 0; op->jobs = 0;
+		}
+	}
+	if (op->mapname || op->multipass) {
+		rmap = rmap_open(op->mapname);
+		if (!rmap) {
+			fplog(stderr, FATAL, "reading map file %s failed: %s\n",
+			      op->mapname, strerror(errno));
+			cleanup(1); exit(17);
+		}
+	}
+
 	if (op->dosplice) {
 		fplog(stderr, INFO, "splice copy, ignoring -a, -r, -y, -R, -W\n");
 		op->reverse = 0;
 	}
 
+	if (op->uring_qd) {
+#ifdef HAVE_LINUX_IO_URING_H
+		if (op->reverse || fst->i_chr || op->i_repeat || dop->prng_libc || dop->prng_frnd
+		    || op->softbs <= op->hardbs) {
+			fplog(stderr, WARN, "io_uring only for forward copies from seekable input with softbs > hardbs, disabled\n");
+			op->uring_qd = 0;
+		} else if (op->uring_qd > 4096) {
+			fplog(stderr, WARN, "io_uring queue depth limited to 4096\n");
+			op->uring_qd = 4096;
+		}
+#else
+		fplog(stderr, WARN, "no io_uring support compiled in, ignoring -U\n");
+		op->uring_qd = 0;
+#endif
+	}
+
+	if (op->pipe_bufs) {
+#ifdef USE_PTHREAD
+		if (fst->i_chr || op->i_repeat || dop->prng_libc || dop->prng_frnd
+		    || op->softbs <= op->hardbs || op->dosplice || op->uring_qd) {
+			fplog(stderr, WARN, "read-ahead thread needs seekable input, softbs > hardbs and no -k/-U, disabled\n");
+			op->pipe_bufs = 0;
+		} else if (op->pipe_bufs < 2) {
+			fplog(stderr, INFO, "read-ahead needs at least 2 buffers\n");
+			op->pipe_bufs = 2;
+		}
+#else
+		fplog(stderr, WARN, "no thread support compiled in, ignoring -Q\n");
+		op->pipe_bufs = 0;
+#endif
+	}
+
 	if (op->noextend || op->extend) {
 		if (output_length(op, fst) == -1) {
 			fplog(stderr, FATAL, "asked to (not) extend output file but can't determine size\n");
@@ -3423,6 +6933,191 @@ void sanitize_and_prepare(opt_t *op, dpopt_t *dop, fstate_t *fst, dpstate_t *dst
 			op->init_opos += fst->fin_opos;
 	}
 	input_length(op, fst);
+	if (op->extents) {
+#ifdef FS_IOC_FIEMAP
+		if (op->reverse || fst->i_chr || !fst->fin_ipos || op->i_repeat
+		    || dop->prng_libc || dop->prng_frnd || dop->bsim715 || op->nosparse
+		    || op->multipass || op->resume) {
+			fplog(stderr, WARN, "extent copy needs forward copy from a regular file\n");
+			fplog(stderr, WARN, " and can't be combined with -A, -N, -K; disabling -X\n");
+			op->extents = 0;
+		} else {
+			if (op->dosplice || op->uring_qd || op->pipe_bufs) {
+				fplog(stderr, INFO, "extent copy: ignoring -k, -U, -Q\n");
+				op->dosplice = 0; op->uring_qd = 0; op->pipe_bufs = 0;
+			}
+			/* Holes are skipped, so the output is sparse */
+			if (!op->sparse) {
+				op->sparse = 1;
+				if (!op->extend)
+					sparse_output_warn(op, fst);
+			}
+		}
+#else
+		fplog(stderr, WARN, "no FIEMAP support compiled in, ignoring -X\n");
+		op->extents = 0;
+#endif
+	}
+	if (op->jobs > 1) {
+#ifdef USE_PTHREAD
+		if (op->reverse || fst->i_chr || fst->o_chr || !fst->fin_ipos
+		    || op->i_repeat || dop->prng_libc || dop->prng_frnd || dop->bsim715
+		    || op->dosplice || op->uring_qd || op->pipe_bufs) {
+			fplog(stderr, WARN, "parallel copy needs forward copy between seekable files of known length\n");
+			fplog(stderr, WARN, " and can't be combined with -k, -U, -Q; disabling -j\n");
+			op->jobs = 0;
+		}
+#else
+		fplog(stderr, WARN, "no thread support compiled in, ignoring -j\n");
+		op->jobs = 0;
+#endif
+	}
+	if (op->adaptive && (op->softbs <= op->hardbs || op->uring_qd || op->pipe_bufs || op->jobs > 1)) {
+		fplog(stderr, WARN, "adaptive block size needs softbs > hardbs and no -U, -Q, -j; disabled\n");
+		op->adaptive = 0;
+	}
+	if (op->offload) {
+#ifdef HAVE_OFFLOAD
+		if (op->reverse || fst->i_chr || fst->o_chr || op->i_repeat
+		    || dop->prng_libc || dop->prng_frnd || dop->bsim715 || ofiles || op->avoidwrite
+		    || op->uring_qd || op->pipe_bufs || op->jobs > 1
+		    || op->extents || op->multipass || op->resume) {
+			fplog(stderr, WARN, "kernel offload copy needs forward copy between seekable files\n");
+			fplog(stderr, WARN, " and can't be combined with -W, -Y, -U, -Q, -j, -X, -N, -K; disabling -H\n");
+			op->offload = 0;
+		} else if (op->dosplice) {
+			fplog(stderr, INFO, "kernel offload copy, disabling -k\n");
+			op->dosplice = 0;
+		}
+#else
+		fplog(stderr, WARN, "no copy_file_range/reflink support compiled in, ignoring -H\n");
+		op->offload = 0;
+#endif
+	}
+	if (op->mmapin) {
+		if (fst->i_chr || op->i_repeat || dop->prng_libc || dop->prng_frnd || dop->bsim715
+		    || op->o_dir_in || op->dosplice || op->offload || op->uring_qd || op->pipe_bufs
+		    || op->jobs > 1 || plug_output_chg) {
+			fplog(stderr, WARN, "mmap input needs seekable input, no plugins that change data\n");
+			fplog(stderr, WARN, " and can't be combined with -d, -k, -H, -U, -Q, -j; disabling -I\n");
+			op->mmapin = 0;
+		} else if (mm_init(fst)) {
+			fplog(stderr, WARN, "can't determine size of %s for mmap, disabling -I\n", op->iname);
+			op->mmapin = 0;
+		}
+	}
+	if (op->sgio_tmo) {
+#ifdef HAVE_SCSI_SG_H
+		int err;
+		if (fst->i_chr || op->dosplice || op->offload || op->uring_qd || op->mmapin) {
+			fplog(stderr, WARN, "SG_IO needs a SCSI block device as input and can't be combined\n");
+			fplog(stderr, WARN, " with -k, -H, -U, -I; disabling -7\n");
+			op->sgio_tmo = 0;
+		} else if ((err = sgio_probe(fst->ides, &sgdev))) {
+			fplog(stderr, WARN, "no SG_IO for %s: %s, disabling -7\n", op->iname,
+			      err == -EXDEV? "partition, needs the whole disk": strerror(-err));
+			op->sgio_tmo = 0;
+		} else {
+			fplog(stderr, INFO, "reading %s via SG_IO (block size %i, max %ikiB per command)\n",
+			      op->iname, sgdev.lbsz, sgdev.maxbytes/1024);
+			if (op->deadline) {
+				fplog(stderr, INFO, "SG_IO timeout replaces deadline (-6)\n");
+				op->deadline = 0;
+			}
+		}
+#else
+		fplog(stderr, WARN, "no SG_IO support compiled in, ignoring -7\n");
+		op->sgio_tmo = 0;
+#endif
+	}
+	if (op->deadline) {
+#ifdef USE_PTHREAD
+		if (fst->i_chr || op->dosplice || op->offload || op->uring_qd || op->mmapin) {
+			fplog(stderr, WARN, "read deadline needs seekable input and can't be combined\n");
+			fplog(stderr, WARN, " with -k, -H, -U, -I; disabling -6\n");
+			op->deadline = 0;
+		}
+#else
+		fplog(stderr, WARN, "no thread support compiled in, ignoring -6\n");
+		op->deadline = 0;
+#endif
+	}
+	if (op->revahead < 0)
+		op->revahead = (op->reverse || op->multipass)? 8*(loff_t)op->softbs: 0;
+#ifdef HAVE_POSIX_FADVISE
+	if (op->evict && op->jobs > 1) {
+		fplog(stderr, WARN, "page cache eviction can't be combined with -j, ignoring -0\n");
+		op->evict = 0;
+	} else if (op->evict && op->evict < (loff_t)op->softbs) {
+		fplog(stderr, WARN, "eviction window smaller than softbs, setting to %skiB\n",
+		      fmt_kiB(op->softbs, !nocol));
+		op->evict = op->softbs;
+	}
+#else
+	if (op->evict) {
+		fplog(stderr, WARN, "no posix_fadvise support compiled in, ignoring -0\n");
+		op->evict = 0;
+	}
+#endif
+#ifdef HAVE_POSIX_FADVISE
+	if (fst->i_chr || op->dosplice || op->offload || op->uring_qd || op->sgio_tmo)
+		op->revahead = 0;
+	else if (op->revahead && op->revahead < 2*(loff_t)op->softbs) {
+		fplog(stderr, WARN, "reverse readahead needs to be at least 2*softbs, setting to %skiB\n",
+		      fmt_kiB(2*op->softbs, !nocol));
+		op->revahead = 2*op->softbs;
+	}
+#else
+	op->revahead = 0;
+#endif
+#ifdef O_DIRECT
+	/* Misaligned parts are handled, so block devices can use O_DIRECT
+	 * by default; not for the modes that bypass mypread()/mypwrite(),
+	 * nor for reverse copies (and the backwards passes of -N), which
+	 * read ahead via the page cache */
+	const char autodio = !op->buffered && !op->dosplice && !op->offload && !op->uring_qd;
+	if (!fst->i_chr)
+		fst->dio_ialign = dio_setup(fst->ides, op->o_dir_in,
+					    autodio && !op->mmapin && !((op->reverse || op->multipass) && op->revahead), op->iname);
+	if (!fst->o_chr)
+		fst->dio_oalign = dio_setup(fst->odes, op->o_dir_out, autodio, op->oname);
+#endif
+	if (op->rwflags) {
+#ifdef HAVE_RWF
+		if (op->dosplice || op->offload || op->uring_qd || op->mmapin || op->sgio_tmo) {
+			fplog(stderr, WARN, "I/O flags apply to normal reads and writes and can't be combined\n");
+			fplog(stderr, WARN, " with -k, -H, -U, -I, -7; disabling -8\n");
+			op->rwflags = 0;
+		}
+		if ((op->rwflags & RWF_MODE_HIPRI) && !fst->dio_ialign && !fst->dio_oalign) {
+			fplog(stderr, WARN, "polled I/O needs O_DIRECT (-d/-D), ignoring hipri\n");
+			op->rwflags &= ~RWF_MODE_HIPRI;
+		}
+		if ((op->rwflags & RWF_MODE_NOWAIT) && (fst->i_chr || fst->dio_ialign)) {
+			fplog(stderr, WARN, "nowait only helps buffered reads from seekable input, ignoring it\n");
+			op->rwflags &= ~RWF_MODE_NOWAIT;
+		}
+		rwf_mode = op->rwflags;
+#else
+		fplog(stderr, WARN, "no preadv2/pwritev2 support compiled in, ignoring -8\n");
+		op->rwflags = 0;
+#endif
+	}
+	zrun_init(op, fst);
+	if (op->latname) {
+		loff_t regsz = LAT_MINREG;
+		while (fst->fin_ipos/regsz > LAT_MAXREGS)
+			regsz *= 2;
+		latmap = latmap_new(op->latname, regsz);
+		if (!latmap) {
+			fplog(stderr, FATAL, "allocating latency map failed: %s\n", strerror(errno));
+			cleanup(1); exit(18);
+		}
+		snprintf(lat_hdr, sizeof(lat_hdr), "dd_rescue latency file for %s, region size %lli",
+			 op->iname, (long long)regsz);
+		if (op->dosplice || op->offload || op->uring_qd || op->mmapin)
+			fplog(stderr, WARN, "latencies are not measured for -k, -H, -U, -I transfers\n");
+	}
 	/* Ajdust update frequency for small (<80MiB) and large (>1GiB) transfers */
 	if (fst->estxfer) {
 		if (fst->estxfer < 80*1024*1024)
@@ -3457,18 +7152,16 @@ void sanitize_and_prepare(opt_t *op, dpopt_t *dop, fstate_t *fst, dpstate_t *dst
 		if (ftruncate(fst->odes, op->init_opos))
 			fplog(stderr, WARN, "Could not truncate %s to %skiB: %s!\n",
 				op->oname, fmt_kiB(op->init_opos, !nocol), strerror(errno));
-	if (op->maxkbs) {
-		/* Ev 8s, but only ev. second is synced, kB */
-		int upd = 4096*op->maxkbs/op->softbs;
-		if (!upd) {
-			upd = 1;
-			fplog(stderr, WARN, "Lower softbs (-b) to achieve low ratecontrol\n");
-		}
-		if (upd < updstat) {
-			if (op->verbose)
-				fplog(stderr, INFO, "Need to update stat every %i softbs\n", upd);
-			updstat = upd;
+	/* Bursts below one block would just make us sleep after each block */
+	if (op->maxkbs || op->maxwrkbs) {
+		unsigned int burst = op->rateburst;
+		if (burst && burst < op->softbs/1024) {
+			fplog(stderr, WARN, "rate limit burst below softbs (-b), raising to %ikiB\n",
+			      op->softbs/1024);
+			burst = op->softbs/1024;
 		}
+		tbucket_init(&rd_bucket, op->maxkbs, burst);
+		tbucket_init(&wr_bucket, op->maxwrkbs, burst);
 	}
 
 }
@@ -3538,8 +7231,20 @@ int main(int argc, char* argv[])
 		cleanup(1);
 		exit(13);
 	}
-	if (plugins_loaded && opts->dosplice) {
-		fplog(stderr, FATAL, "Plugins can't handle splice\n");
+	if (plug_no_seek && (opts->resume || opts->multipass)) {
+		fplog(stderr, FATAL, "Plugins can't handle out-of-order positions (-K, -N)\n");
+		//unload_plugins();
+		cleanup(1);
+		exit(13);
+	}
+	if (plug_no_seek && (opts->jobs > 1 || opts->extents)) {
+		fplog(stderr, FATAL, "Plugins can't handle out-of-order positions (-j, -X)\n");
+		//unload_plugins();
+		cleanup(1);
+		exit(13);
+	}
+	if (plugins_loaded && (opts->dosplice || opts->offload)) {
+		fplog(stderr, FATAL, "Plugins can't handle splice or kernel offload copy\n");
 		//unload_plugins();
 		cleanup(1);
 		exit(13);
@@ -3580,6 +7285,10 @@ int main(int argc, char* argv[])
 			fplog(stderr, WARN, "Input file and secondary output file %s are identical!\n", oft->name);
 		oft->fd = openfile(oft->name, (opts->avoidwrite? O_RDWR: O_WRONLY) | O_CREAT | opts->o_dir_out | opts->dotrunc);
 		check_seekable(oft->fd, &(oft->cdev), NULL);
+#ifdef O_DIRECT
+		if (opts->o_dir_out && !oft->cdev)
+			oft->dioal = dio_setup(oft->fd, opts->o_dir_out, 0, oft->name);
+#endif
 		if (opts->preserve)
 			copyperm(fstate->ides, oft->fd);
 #if defined(HAVE_FALLOCATE64) || defined(HAVE_LIBFALLOCATE)
@@ -3591,6 +7300,12 @@ int main(int argc, char* argv[])
 				fplog(stderr, WARN, "Could not truncate %s to %skiB: %s!\n",
 					oft->name, fmt_kiB(opts->init_opos, !nocol), strerror(errno));
 	}
+#ifdef USE_PTHREAD
+	if (ofiles && !opts->dosplice)
+		owriters_start(opts, fstate);
+	if (opts->avoidwrite && !fstate->o_chr && !opts->reverse && opts->jobs <= 1)
+		tgtpf_init(opts, fstate);
+#endif
 
 	/* Install signal handler */
 	signal(SIGHUP , breakhandler);
@@ -3598,6 +7313,9 @@ int main(int argc, char* argv[])
 	signal(SIGTERM, breakhandler);
 	/* Used to signal clean abort from plugins */
 	signal(SIGQUIT, breakhandler);
+	/* Write out latency file on demand */
+	if (latmap)
+		signal(SIGUSR1, latdumphandler);
 
 	/* Save time and start to work */
 	fstate->ipos = opts->init_ipos;
@@ -3624,6 +7342,33 @@ int main(int argc, char* argv[])
 #endif
 		{
 			call_plugins_open(opts, fstate);
+			if (opts->multipass)
+				err = copyfile_multipass(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else if (opts->resume)
+				err = copyfile_resume(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else
+#ifdef FS_IOC_FIEMAP
+			if (opts->extents)
+				err = copyfile_extents(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+			if (opts->uring_qd)
+				err = copyfile_uring(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else
+#endif
+#ifdef USE_PTHREAD
+			if (opts->pipe_bufs)
+				err = copyfile_pipeline(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else if (opts->jobs > 1)
+				err = copyfile_jobs(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else
+#endif
+#ifdef HAVE_OFFLOAD
+			if (opts->offload)
+				err = copyfile_offload(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
+			else
+#endif
 			if (opts->softbs > opts->hardbs)
 				err = copyfile_softbs(opts->maxxfer, opts, fstate, progress, repeat, dpopts, dpstate);
 			else
@@ -27,6 +27,23 @@ typedef struct _opt_t {
 	char noextend, avoidwrite, avoidnull;
 	char extend, rmvtrim, i_repeat;
 	unsigned int maxkbs; /* from 1kB/s to 4TB/s */
+	unsigned int maxwrkbs, rateburst;
+	int ioprio;
+	unsigned int uring_qd;
+	unsigned int pipe_bufs;
+	unsigned int jobs;
+	char worker;
+	const char *mapname;
+	char resume, multipass, revscrape;
+	char adaptive, extents;
+	char offload, mmapin;
+	char buffered;
+	const char *latname;
+	unsigned int deadline; /* ms */
+	unsigned int sgio_tmo; /* ms */
+	char rwflags;
+	loff_t revahead;
+	loff_t evict;
 } opt_t;
 extern char nocol;
 
@@ -51,6 +68,10 @@ typedef struct _fstate_t {
 	char i_chr, o_chr, o_blk, o_lnk;
 	int nrerr;
 	char identical;
+	/* O_DIRECT alignment (logical block size), 0 if not direct */
+	unsigned int dio_ialign, dio_oalign;
+	/* Reverse readahead: advised down to ra_lo, last read at ra_pos */
+	loff_t ra_lo, ra_pos;
 } fstate_t;
 
 /* Progress */
@@ -38,7 +38,9 @@
 # define FITHAW		_IOWR('X', 120, int)	/* Thaw */
 #endif
 
+#ifdef TEST_FIEMAP
 char quiet = 0;
+#endif
 
 int unfreeze_fd = 0;
 
@@ -51,12 +53,15 @@ void unfreeze_handler(int sig)
 	raise(sig);
 }
 
-int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len, 
-			  struct fiemap_extent **ext, const int needfreeze)
+/* Fetch extent list for [start,start+len[; freeze: 0 = don't freeze the FS,
+ * 1 = try, 2 = must freeze. */
+static int fiemap_get(const int fd, const uint64_t start, const uint64_t len,
+		      struct fiemap_extent **ext, const int freeze)
 {
 	int err;
 	struct fiemap fmap;
-	sync();
+	if (freeze)
+		sync();
 	//struct fiemap_extent *fmap_exts;
 	fmap.fm_start = start;
 	fmap.fm_length = len;
@@ -65,6 +70,11 @@ int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len
 	err = ioctl(fd, FS_IOC_FIEMAP, &fmap);
 	if (err != 0)
 		return -errno;
+	/* Nothing allocated (fully sparse) */
+	if (!freeze && !fmap.fm_mapped_extents) {
+		*ext = NULL;
+		return 0;
+	}
 	if (fmap.fm_mapped_extents)
 		++fmap.fm_mapped_extents;
 	struct fiemap *fm = (struct fiemap*) malloc(sizeof(struct fiemap) 
@@ -73,11 +83,11 @@ int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len
 		return -errno;
 	fm->fm_start = start;
 	fm->fm_length = len;
-	fm->fm_flags = 0;
+	/* Without freezing, data may still be delayed-allocated */
+	fm->fm_flags = freeze? 0: FIEMAP_FLAG_SYNC;
 	fm->fm_extent_count = fmap.fm_mapped_extents;
-	/* TODO: FREEZE */
-	err = ioctl(fd, FIFREEZE, 0);
-	if (err != 0 && needfreeze) {
+	err = freeze? ioctl(fd, FIFREEZE, 0): -1;
+	if (err != 0 && freeze > 1) {
 		free(fm);
 		ext = NULL;
 		return -errno;
@@ -96,17 +106,31 @@ int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len
 		free(fm);
 		ext = NULL;
 		err = errno;
-		ioctl(fd, FITHAW, 0);
+		if (freeze)
+			ioctl(fd, FITHAW, 0);
 		return -err;
 	}
-	/* Correct last extent length */
+	/* Correct last extent length (not for get_mapping(), whose
+	 * callers need to see a trailing hole as such) */
 	struct fiemap_extent *lastext = fm->fm_extents+(fm->fm_mapped_extents-1);
-	if (lastext->fe_flags & FIEMAP_EXTENT_LAST) 
-		lastext->fe_length = len-lastext->fe_logical;
+	if (freeze && (lastext->fe_flags & FIEMAP_EXTENT_LAST))
+		lastext->fe_length = start+len-lastext->fe_logical;
 	*ext = fm->fm_extents;
 	return fm->fm_mapped_extents;
 }
 
+int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len, 
+			  struct fiemap_extent **ext, const int needfreeze)
+{
+	return fiemap_get(fd, start, len, ext, needfreeze? 2: 1);
+}
+
+int get_mapping(const int fd, const uint64_t start, const uint64_t len,
+		struct fiemap_extent **ext)
+{
+	return fiemap_get(fd, start, len, ext, 0);
+}
+
 void free_mapping(const int fd, struct fiemap_extent *ext)
 {
 	if (fd > 0)
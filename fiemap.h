@@ -27,6 +27,20 @@
 # define FS_IOC_FIEMAP			_IOWR('f', 11, struct fiemap)
 #endif
 
+#include <stdint.h>
+
+/* Get the extents of fd in [start,start+len[, freezing the FS while
+ * doing so (fail if needfreeze and this is not possible);
+ * returns the number of extents or -errno. */
+int alloc_and_get_mapping(const int fd, const uint64_t start, const uint64_t len,
+			  struct fiemap_extent **ext, const int needfreeze);
+/* Same without freezing (so we can keep writing to the same FS);
+ * returns 0 with *ext == NULL if nothing is allocated. */
+int get_mapping(const int fd, const uint64_t start, const uint64_t len,
+		struct fiemap_extent **ext);
+/* Release mapping (and thaw FS if fd > 0) */
+void free_mapping(const int fd, struct fiemap_extent *ext);
+
 #endif	/* HAVE_LINUX_FS_H */
 
 #endif	/* _FIEMAPH */
@@ -48,9 +48,11 @@ inline static size_t find_nonzero(const unsigned char* blk, const size_t ln)
 	/* 1st pass: Bytes before 32B aligned block */
 	const unsigned off = (-(unsigned char)(unsigned long)blk) & 0x1f;
 	size_t i;
-	for (i = 0; i < off; ++i)
+	for (i = 0; i < off && i < ln; ++i)
 		if (blk[i])
 			return i;
+	if (off >= ln)
+		return ln;
 	/* Rest without 1st pass */
 	const size_t remain = ln - off;
 	/* Calc size of third pass -- this avoids reading beyond the end of blk */
@@ -61,7 +63,7 @@ inline static size_t find_nonzero(const unsigned char* blk, const size_t ln)
 	if (!r2 || res != remain-r2)
 		return off+res;
 	/* 3rd pass: Trailing bytes */
-	for (i = off+remain; i < ln; ++i)
+	for (i = off+remain-r2; i < ln; ++i)
 		if (blk[i])
 			return i;
 	return ln;
@@ -0,0 +1,148 @@
+/** latmap.c
+ *
+ * I/O latency histograms and per-region read latency map,
+ * used for dd_rescue's latency file.
+ *
+ * File format: CSV with one line "pos,len,reads,avg_us,max_us,errors"
+ * per region that has been read (pos and len in bytes); lines starting
+ * with # are comments and hold the histograms.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#include "latmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+latmap_t* latmap_new(const char* name, loff_t regsz)
+{
+	latmap_t *map = (latmap_t*)calloc(1, sizeof(latmap_t));
+	if (!map)
+		return NULL;
+	map->name = name;
+	map->regsz = regsz;
+	return map;
+}
+
+void latmap_free(latmap_t *map)
+{
+	if (!map)
+		return;
+	free(map->reg);
+	free(map);
+}
+
+static void lathist_add(lathist_t *hist, unsigned int us)
+{
+	int b = us? 32 - __builtin_clz(us): 0;
+	if (b >= LAT_BUCKETS)
+		b = LAT_BUCKETS-1;
+	++hist->cnt[b];
+	++hist->n;
+	hist->sum += us;
+	if (us > hist->max)
+		hist->max = us;
+}
+
+void latmap_read(latmap_t *map, loff_t pos, unsigned int us, char err)
+{
+	const unsigned int r = pos/map->regsz;
+	lathist_add(&map->rd, us);
+	if (r >= map->nreg) {
+		unsigned int nreg = map->nreg? map->nreg: 256;
+		while (nreg <= r)
+			nreg *= 2;
+		latreg_t *reg = (latreg_t*)realloc(map->reg, nreg*sizeof(latreg_t));
+		/* Histograms still work, just lose the region */
+		if (!reg)
+			return;
+		memset(reg+map->nreg, 0, (nreg-map->nreg)*sizeof(latreg_t));
+		map->reg = reg;
+		map->nreg = nreg;
+	}
+	latreg_t *rg = map->reg + r;
+	++rg->cnt;
+	rg->sum += us;
+	if (us > rg->max)
+		rg->max = us;
+	if (err)
+		++rg->errs;
+}
+
+void latmap_write(latmap_t *map, unsigned int us)
+{
+	lathist_add(&map->wr, us);
+}
+
+unsigned int lathist_pct(const lathist_t *hist, double pct)
+{
+	unsigned long long sum = 0;
+	int i;
+	if (!hist->n)
+		return 0;
+	for (i = 0; i < LAT_BUCKETS-1; ++i) {
+		sum += hist->cnt[i];
+		if (sum >= hist->n*pct/100)
+			break;
+	}
+	return i < LAT_BUCKETS-1? 1U << i: hist->max;
+}
+
+static void lathist_print(FILE *f, const char* nm, const lathist_t *hist)
+{
+	int i, last = LAT_BUCKETS-1;
+	while (last > 0 && !hist->cnt[last])
+		--last;
+	fprintf(f, "# %s: n=%llu avg=%llu max=%u (us), <us:count", nm, hist->n,
+		hist->n? hist->sum/hist->n: 0, hist->max);
+	for (i = 0; i <= last; ++i)
+		fprintf(f, " %u:%llu", 1U << i, hist->cnt[i]);
+	fprintf(f, "\n");
+}
+
+int latmap_save(const latmap_t *map, const char* hdr)
+{
+	unsigned int i;
+	const size_t nln = strlen(map->name);
+	char *tmpnm = (char*)malloc(nln+5);
+	if (!tmpnm)
+		return -ENOMEM;
+	memcpy(tmpnm, map->name, nln);
+	memcpy(tmpnm+nln, ".tmp", 5);
+	FILE *f = fopen(tmpnm, "w");
+	if (!f)
+		goto err;
+	fprintf(f, "# %s\n", hdr);
+	lathist_print(f, "read", &map->rd);
+	lathist_print(f, "write", &map->wr);
+	fprintf(f, "# pos,len,reads,avg_us,max_us,errors\n");
+	for (i = 0; i < map->nreg; ++i) {
+		const latreg_t *rg = map->reg + i;
+		if (!rg->cnt)
+			continue;
+		fprintf(f, "%llu,%llu,%u,%llu,%u,%u\n",
+			(unsigned long long)i*map->regsz, (unsigned long long)map->regsz,
+			rg->cnt, rg->sum/rg->cnt, rg->max, rg->errs);
+	}
+	if (fclose(f))
+		goto err_rm;
+	if (rename(tmpnm, map->name))
+		goto err_rm;
+	free(tmpnm);
+	return 0;
+err_rm:
+	{
+		int err = errno;
+		unlink(tmpnm);
+		errno = err;
+	}
+err:
+	{
+		int err = errno;
+		free(tmpnm);
+		return -err;
+	}
+}
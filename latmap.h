@@ -0,0 +1,56 @@
+/** latmap.h
+ *
+ * Collects I/O latencies: log2 scaled histograms for reads and
+ * writes plus a per-region map of read latencies and errors of
+ * the input, which can be written to a CSV file (heat map).
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#ifndef _LATMAP_H
+#define _LATMAP_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define _GNU_SOURCE 1
+#include <sys/types.h>
+
+/* Bucket i counts latencies below 2^i us (and >= 2^(i-1) us) */
+#define LAT_BUCKETS 32
+
+typedef struct _lathist {
+	unsigned long long cnt[LAT_BUCKETS];
+	unsigned long long n, sum;
+	unsigned int max;
+} lathist_t;
+
+/* Latencies in us */
+typedef struct _latreg {
+	unsigned int cnt, errs, max;
+	unsigned long long sum;
+} latreg_t;
+
+typedef struct _latmap {
+	const char *name;
+	loff_t regsz;
+	latreg_t *reg;
+	unsigned int nreg;
+	lathist_t rd, wr;
+} latmap_t;
+
+/* New map for output file name with regions of regsz bytes;
+ * returns NULL on error (errno) */
+latmap_t* latmap_new(const char* name, loff_t regsz);
+void latmap_free(latmap_t *map);
+/* Account a read at input position pos taking us microseconds */
+void latmap_read(latmap_t *map, loff_t pos, unsigned int us, char err);
+void latmap_write(latmap_t *map, unsigned int us);
+/* Latency (upper bucket bound in us) below which pct percent of the I/Os are */
+unsigned int lathist_pct(const lathist_t *hist, double pct);
+/* Atomically write CSV file (tmp file + rename), first line comment hdr;
+ * returns 0 or -errno */
+int latmap_save(const latmap_t *map, const char* hdr);
+
+#endif	/* _LATMAP_H */
@@ -0,0 +1,310 @@
+/** rescuemap.c
+ *
+ * Sorted extent list of input region states with load/save,
+ * used for dd_rescue's map file and resume.
+ *
+ * File format: Lines "pos size state" with pos and size in hex
+ * (0x prefix) and state one of ?*-/+ ; lines starting with #
+ * are comments. Untried regions don't need to be listed.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#include "rescuemap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+
+static int rmap_valid_state(char st)
+{
+	return st == RMAP_UNTRIED || st == RMAP_NONTRIMMED || st == RMAP_NONSCRAPED
+		|| st == RMAP_BAD || st == RMAP_GOOD;
+}
+
+static void rmap_reserve(rmap_t *map, unsigned int need)
+{
+	if (map->alloc >= need)
+		return;
+	while (map->alloc < need)
+		map->alloc = map->alloc? 2*map->alloc: 64;
+	map->ext = (rmap_ext_t*)realloc(map->ext, map->alloc*sizeof(rmap_ext_t));
+	assert(map->ext);
+}
+
+rmap_t* rmap_open(const char* name)
+{
+	rmap_t *map = (rmap_t*)calloc(1, sizeof(rmap_t));
+	if (!map)
+		return NULL;
+	map->name = name;
+	map->lastsave = time(NULL);
+	/* In-memory only */
+	if (!name)
+		return map;
+	FILE *f = fopen(name, "r");
+	if (!f) {
+		if (errno == ENOENT)
+			return map;
+		free(map);
+		return NULL;
+	}
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long pos, len;
+		char st;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%llx %llx %c", &pos, &len, &st) != 3 || !rmap_valid_state(st)) {
+			fclose(f);
+			rmap_free(map);
+			errno = EINVAL;
+			return NULL;
+		}
+		rmap_mark(map, pos, len, st);
+	}
+	fclose(f);
+	map->dirty = 0;
+	return map;
+}
+
+void rmap_free(rmap_t *map)
+{
+	if (!map)
+		return;
+	free(map->ext);
+	free(map);
+}
+
+/* Index of first extent that ends after pos */
+static unsigned int rmap_find(const rmap_t *map, loff_t pos)
+{
+	unsigned int lo = 0, hi = map->next;
+	while (lo < hi) {
+		unsigned int mid = (lo+hi)/2;
+		if (map->ext[mid].pos + map->ext[mid].len <= pos)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void rmap_mark(rmap_t *map, loff_t pos, loff_t len, char state)
+{
+	if (len <= 0)
+		return;
+	const loff_t end = pos+len;
+	unsigned int i = rmap_find(map, pos), j = i;
+	rmap_ext_t left, right;
+	char hasleft = 0, hasright = 0;
+	/* Fast path: Extend previous extent with the same state */
+	if (i > 0 && (i == map->next || map->ext[i].pos >= end)
+	    && map->ext[i-1].state == state
+	    && map->ext[i-1].pos + map->ext[i-1].len == pos) {
+		map->ext[i-1].len += len;
+		if (i < map->next && map->ext[i].pos == end && map->ext[i].state == state) {
+			map->ext[i-1].len += map->ext[i].len;
+			memmove(map->ext+i, map->ext+i+1, (map->next-i-1)*sizeof(rmap_ext_t));
+			--map->next;
+		}
+		map->dirty = 1;
+		return;
+	}
+	/* Overlapped extents [i,j[ will be replaced by left, new, right */
+	while (j < map->next && map->ext[j].pos < end)
+		++j;
+	if (i < j && map->ext[i].pos < pos) {
+		left = map->ext[i];
+		left.len = pos - left.pos;
+		hasleft = 1;
+	}
+	if (i < j && map->ext[j-1].pos + map->ext[j-1].len > end) {
+		right = map->ext[j-1];
+		right.len = right.pos + right.len - end;
+		right.pos = end;
+		hasright = 1;
+	}
+	const unsigned int nnew = hasleft + 1 + hasright;
+	rmap_reserve(map, map->next - (j-i) + nnew);
+	memmove(map->ext+i+nnew, map->ext+j, (map->next-j)*sizeof(rmap_ext_t));
+	map->next += nnew - (j-i);
+	if (hasleft)
+		map->ext[i++] = left;
+	map->ext[i].pos = pos; map->ext[i].len = len; map->ext[i].state = state;
+	if (hasright)
+		map->ext[i+1] = right;
+	/* Merge with neighbours */
+	if (i+1 < map->next && map->ext[i+1].state == state && map->ext[i+1].pos == end) {
+		map->ext[i].len += map->ext[i+1].len;
+		memmove(map->ext+i+1, map->ext+i+2, (map->next-i-2)*sizeof(rmap_ext_t));
+		--map->next;
+	}
+	if (i > 0 && map->ext[i-1].state == state && map->ext[i-1].pos + map->ext[i-1].len == pos) {
+		map->ext[i-1].len += map->ext[i].len;
+		memmove(map->ext+i, map->ext+i+1, (map->next-i-1)*sizeof(rmap_ext_t));
+		--map->next;
+	}
+	map->dirty = 1;
+}
+
+char rmap_state(const rmap_t *map, loff_t pos, loff_t *len)
+{
+	const unsigned int i = rmap_find(map, pos);
+	if (i == map->next) {
+		*len = -1;
+		return RMAP_UNTRIED;
+	}
+	if (map->ext[i].pos > pos) {
+		*len = map->ext[i].pos - pos;
+		return RMAP_UNTRIED;
+	}
+	*len = map->ext[i].pos + map->ext[i].len - pos;
+	return map->ext[i].state;
+}
+
+static inline int rmap_match(char st, char state, char neg)
+{
+	return neg? st != state: st == state;
+}
+
+/* First region at or after pos (before end) matching (or, if neg, not matching) state */
+static loff_t rmap_fwd(const rmap_t *map, loff_t pos, loff_t end, loff_t *len,
+		       char state, char neg)
+{
+	loff_t ln;
+	/* Skip non-matching */
+	while (!rmap_match(rmap_state(map, pos, &ln), state, neg)) {
+		if (ln == -1)
+			return -1;
+		pos += ln;
+		if (end && pos >= end)
+			return -1;
+	}
+	if (end && pos >= end)
+		return -1;
+	/* Collect matching */
+	const loff_t start = pos;
+	while (ln != -1 && (!end || pos+ln < end)) {
+		pos += ln;
+		if (!rmap_match(rmap_state(map, pos, &ln), state, neg)) {
+			*len = pos - start;
+			return start;
+		}
+	}
+	*len = end? end - start: -1;
+	return start;
+}
+
+/* State of the byte before pos, distance to the start of that region in *len */
+static char rmap_state_before(const rmap_t *map, loff_t pos, loff_t *len)
+{
+	const unsigned int i = rmap_find(map, pos-1);
+	if (i < map->next && map->ext[i].pos < pos) {
+		*len = pos - map->ext[i].pos;
+		return map->ext[i].state;
+	}
+	*len = pos - (i > 0? map->ext[i-1].pos + map->ext[i-1].len: 0);
+	return RMAP_UNTRIED;
+}
+
+/* Last region ending at or before pos (not below begin) matching state (resp. not) */
+static loff_t rmap_bwd(const rmap_t *map, loff_t pos, loff_t begin, loff_t *len,
+		       char state, char neg)
+{
+	loff_t ln;
+	/* Skip non-matching */
+	while (pos > begin && !rmap_match(rmap_state_before(map, pos, &ln), state, neg))
+		pos -= ln;
+	if (pos <= begin)
+		return -1;
+	/* Collect matching */
+	const loff_t end = pos;
+	while (pos > begin && rmap_match(rmap_state_before(map, pos, &ln), state, neg))
+		pos -= ln;
+	if (pos < begin)
+		pos = begin;
+	*len = end - pos;
+	return end;
+}
+
+loff_t rmap_next(const rmap_t *map, loff_t pos, loff_t end, char state, loff_t *len)
+{
+	return rmap_fwd(map, pos, end, len, state, 0);
+}
+
+loff_t rmap_prev(const rmap_t *map, loff_t pos, loff_t begin, char state, loff_t *len)
+{
+	return rmap_bwd(map, pos, begin, len, state, 0);
+}
+
+loff_t rmap_next_nongood(const rmap_t *map, loff_t pos, loff_t end, loff_t *len)
+{
+	return rmap_fwd(map, pos, end, len, RMAP_GOOD, 1);
+}
+
+loff_t rmap_prev_nongood(const rmap_t *map, loff_t pos, loff_t begin, loff_t *len)
+{
+	return rmap_bwd(map, pos, begin, len, RMAP_GOOD, 1);
+}
+
+loff_t rmap_count(const rmap_t *map, loff_t begin, loff_t end, char state)
+{
+	loff_t sum = 0, ln;
+	while (begin < end) {
+		char st = rmap_state(map, begin, &ln);
+		if (ln == -1 || begin+ln > end)
+			ln = end-begin;
+		if (st == state)
+			sum += ln;
+		begin += ln;
+	}
+	return sum;
+}
+
+int rmap_save(rmap_t *map)
+{
+	unsigned int i;
+	if (!map->name)
+		return 0;
+	const size_t nln = strlen(map->name);
+	char *tmpnm = (char*)malloc(nln+5);
+	/* Don't retry failed saves on each update */
+	map->lastsave = time(NULL);
+	if (!tmpnm)
+		return -ENOMEM;
+	memcpy(tmpnm, map->name, nln);
+	memcpy(tmpnm+nln, ".tmp", 5);
+	FILE *f = fopen(tmpnm, "w");
+	if (!f)
+		goto err;
+	fprintf(f, "# dd_rescue map file\n# pos size state(?*/-+)\n");
+	for (i = 0; i < map->next; ++i)
+		fprintf(f, "0x%08llx 0x%08llx %c\n", (unsigned long long)map->ext[i].pos,
+			(unsigned long long)map->ext[i].len, map->ext[i].state);
+	if (fflush(f) || fsync(fileno(f))) {
+		fclose(f);
+		goto err_rm;
+	}
+	if (fclose(f))
+		goto err_rm;
+	if (rename(tmpnm, map->name))
+		goto err_rm;
+	free(tmpnm);
+	map->dirty = 0;
+	return 0;
+err_rm:
+	{
+		int err = errno;
+		unlink(tmpnm);
+		errno = err;
+	}
+err:
+	{
+		int err = errno;
+		free(tmpnm);
+		return -err;
+	}
+}
@@ -0,0 +1,68 @@
+/** rescuemap.h
+ *
+ * Keeps track of the state of input regions (untried, good, bad, ...)
+ * in a sorted extent list that can be saved to and loaded from a
+ * small text file, allowing to resume an interrupted rescue.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#ifndef _RESCUEMAP_H
+#define _RESCUEMAP_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define _GNU_SOURCE 1
+#include <sys/types.h>
+#include <time.h>
+
+/* Region states (same characters as GNU ddrescue mapfiles) */
+#define RMAP_UNTRIED	'?'
+#define RMAP_NONTRIMMED	'*'
+#define RMAP_NONSCRAPED	'/'
+#define RMAP_BAD	'-'
+#define RMAP_GOOD	'+'
+
+typedef struct _rmap_ext {
+	loff_t pos, len;
+	char state;
+} rmap_ext_t;
+
+/* Extents are sorted and don't overlap; gaps are untried */
+typedef struct _rmap {
+	const char *name;
+	rmap_ext_t *ext;
+	unsigned int next, alloc;
+	time_t lastsave;
+	char dirty;
+} rmap_t;
+
+/* Load map from file name (if it exists, name may be NULL for an
+ * in-memory map); returns NULL on error (errno) */
+rmap_t* rmap_open(const char* name);
+void rmap_free(rmap_t *map);
+/* Set state of [pos,pos+len[ */
+void rmap_mark(rmap_t *map, loff_t pos, loff_t len, char state);
+/* State at pos, length of the region with that state in *len (-1 = inf) */
+char rmap_state(const rmap_t *map, loff_t pos, loff_t *len);
+/* First region at or after pos (before end, 0 = inf) in state;
+ * returns start or -1 if none, and its length in *len (-1 = inf) */
+loff_t rmap_next(const rmap_t *map, loff_t pos, loff_t end, char state, loff_t *len);
+/* Last region ending at or before pos (not below begin) in state;
+ * returns its end or -1 if none, and its length in *len */
+loff_t rmap_prev(const rmap_t *map, loff_t pos, loff_t begin, char state, loff_t *len);
+/* First region at or after pos (before end, 0 = inf) that is not good;
+ * returns start or -1 if none, and its length in *len (-1 = inf) */
+loff_t rmap_next_nongood(const rmap_t *map, loff_t pos, loff_t end, loff_t *len);
+/* Last region ending at or before pos (not below begin) that is not good;
+ * returns its end or -1 if none, and its length in *len */
+loff_t rmap_prev_nongood(const rmap_t *map, loff_t pos, loff_t begin, loff_t *len);
+/* Sum of bytes in [begin,end[ in state */
+loff_t rmap_count(const rmap_t *map, loff_t begin, loff_t end, char state);
+/* Atomically write map file (tmp file + rename), nothing for in-memory
+ * maps; returns 0 or -errno */
+int rmap_save(rmap_t *map);
+
+#endif	/* _RESCUEMAP_H */
@@ -0,0 +1,210 @@
+/** sgio.c
+ *
+ * SCSI passthrough reads for dd_rescue: READ CAPACITY to probe
+ * the device, READ(16) via SG_IO with a bounded timeout; the
+ * kernel does not retry these commands, so dd_rescue's own
+ * retry strategy applies. Sense data is decoded for the log.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#include "sgio.h"
+
+#ifdef HAVE_SCSI_SG_H
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <scsi/sg.h>
+#include <linux/fs.h>
+
+#define SENSE_LEN 64
+/* Status, host status for timeouts (DID_TIME_OUT) */
+#define SAM_CHECK_CONDITION 0x02
+#define HOST_TIME_OUT 0x03
+
+static const char* sense_keys[16] = {
+	"no sense", "recovered error", "not ready", "medium error",
+	"hardware error", "illegal request", "unit attention", "data protect",
+	"blank check", "vendor specific", "copy aborted", "aborted command",
+	"reserved", "volume overflow", "miscompare", "completed",
+};
+
+static inline void put_be(unsigned char *p, unsigned long long val, int ln)
+{
+	while (ln--) {
+		p[ln] = val & 0xff;
+		val >>= 8;
+	}
+}
+
+static inline unsigned long long get_be(const unsigned char *p, int ln)
+{
+	unsigned long long val = 0;
+	while (ln--)
+		val = val << 8 | *p++;
+	return val;
+}
+
+static int sg_cmd(int fd, unsigned char *cdb, int cdblen, void *buf, size_t len,
+		  unsigned int tmo, sg_io_hdr_t *hdr, unsigned char *sense)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->interface_id = 'S';
+	hdr->dxfer_direction = SG_DXFER_FROM_DEV;
+	hdr->cmd_len = cdblen;
+	hdr->cmdp = cdb;
+	hdr->dxferp = buf;
+	hdr->dxfer_len = len;
+	hdr->sbp = sense;
+	hdr->mx_sb_len = SENSE_LEN;
+	hdr->timeout = tmo;
+	return ioctl(fd, SG_IO, hdr);
+}
+
+int sgio_probe(int fd, sgdev_t *sg)
+{
+	unsigned char cdb[16], resp[32], sense[SENSE_LEN];
+	sg_io_hdr_t hdr;
+	int ver;
+	memset(sg, 0, sizeof(*sg));
+	if (ioctl(fd, SG_GET_VERSION_NUM, &ver) || ver < 30000)
+		return -ENOTTY;
+	/* READ CAPACITY(16) */
+	memset(cdb, 0, 16);
+	cdb[0] = 0x9e; cdb[1] = 0x10;
+	put_be(cdb+10, sizeof(resp), 4);
+	if (!sg_cmd(fd, cdb, 16, resp, sizeof(resp), 30000, &hdr, sense)
+	    && (hdr.info & SG_INFO_OK_MASK) == SG_INFO_OK) {
+		sg->lbsz = get_be(resp+8, 4);
+		sg->cap = (get_be(resp, 8)+1) * sg->lbsz;
+	} else {
+		/* READ CAPACITY(10) */
+		memset(cdb, 0, 10);
+		cdb[0] = 0x25;
+		if (sg_cmd(fd, cdb, 10, resp, 8, 30000, &hdr, sense))
+			return -errno;
+		if ((hdr.info & SG_INFO_OK_MASK) != SG_INFO_OK)
+			return -EIO;
+		sg->lbsz = get_be(resp+4, 4);
+		sg->cap = (get_be(resp, 4)+1) * sg->lbsz;
+	}
+	if (!sg->lbsz || sg->lbsz & (sg->lbsz-1)) {
+		sg->lbsz = 0;
+		return -EINVAL;
+	}
+	struct stat st;
+	if (fstat(fd, &st))
+		return -errno;
+#ifdef BLKGETSIZE64
+	/* SCSI commands address the whole disk: For a partition (which
+	 * sd allows SG_IO on with CAP_SYS_RAWIO), the LBAs would be off */
+	unsigned long long bdsize;
+	if (S_ISBLK(st.st_mode) && !ioctl(fd, BLKGETSIZE64, &bdsize)
+	    && bdsize != (unsigned long long)sg->cap) {
+		sg->lbsz = 0;
+		return -EXDEV;
+	}
+#endif
+	/* Stay within the queue limits, block devices report 512B sectors */
+	sg->maxbytes = 64*1024;
+#ifdef BLKSECTGET
+	unsigned short maxsect;
+	if (S_ISBLK(st.st_mode) && !ioctl(fd, BLKSECTGET, &maxsect) && maxsect)
+		sg->maxbytes = maxsect*512 > 1024*1024? 1024*1024: maxsect*512;
+#endif
+	if (sg->maxbytes < sg->lbsz)
+		sg->maxbytes = sg->lbsz;
+	sg->maxbytes -= sg->maxbytes % sg->lbsz;
+	return 0;
+}
+
+/* Decode sense data: key, asc/ascq and information field (bad LBA) */
+static int sense_decode(const unsigned char *sb, int ln, int *asc, int *ascq,
+			unsigned long long *info, char *infovalid)
+{
+	int key = 0;
+	*infovalid = 0;
+	if (ln < 8)
+		return -1;
+	if ((sb[0] & 0x7f) >= 0x72) {
+		/* Descriptor format */
+		int off = 8;
+		key = sb[1] & 0x0f; *asc = sb[2]; *ascq = sb[3];
+		while (off + 1 < ln && off < 8 + sb[7]) {
+			if (sb[off] == 0 && off + 11 < ln && (sb[off+2] & 0x80)) {
+				*info = get_be(sb+off+4, 8);
+				*infovalid = 1;
+			}
+			off += 2 + sb[off+1];
+		}
+	} else {
+		/* Fixed format */
+		if (ln < 14)
+			return -1;
+		key = sb[2] & 0x0f; *asc = sb[12]; *ascq = sb[13];
+		if (sb[0] & 0x80) {
+			*info = get_be(sb+3, 4);
+			*infovalid = 1;
+		}
+	}
+	return key;
+}
+
+ssize_t sgio_pread(int fd, const sgdev_t *sg, void *buf, size_t sz, loff_t off,
+		   unsigned int tmo, char *msg, size_t msglen)
+{
+	unsigned char cdb[16], sense[SENSE_LEN];
+	sg_io_hdr_t hdr;
+	const unsigned long long lba = off / sg->lbsz;
+	*msg = 0;
+	if (off >= sg->cap)
+		return 0;
+	if (off + (loff_t)sz > sg->cap)
+		sz = sg->cap - off;
+	memset(cdb, 0, 16);
+	cdb[0] = 0x88;
+	put_be(cdb+2, lba, 8);
+	put_be(cdb+10, sz / sg->lbsz, 4);
+	if (sg_cmd(fd, cdb, 16, buf, sz, tmo, &hdr, sense))
+		return -1;
+	errno = 0;
+	if ((hdr.info & SG_INFO_OK_MASK) == SG_INFO_OK)
+		return sz - hdr.resid;
+	if (hdr.host_status == HOST_TIME_OUT) {
+		snprintf(msg, msglen, "command timed out after %ums", tmo);
+		errno = ETIME;
+		return -1;
+	}
+	if (hdr.status == SAM_CHECK_CONDITION && hdr.sb_len_wr) {
+		int asc = 0, ascq = 0;
+		unsigned long long info = 0;
+		char infovalid;
+		const int key = sense_decode(sense, hdr.sb_len_wr, &asc, &ascq, &info, &infovalid);
+		if (key < 0) {
+			snprintf(msg, msglen, "invalid sense data");
+			errno = EIO;
+			return -1;
+		}
+		if (infovalid)
+			snprintf(msg, msglen, "sense key %s, asc/ascq %02x/%02x, lba %llu",
+				 sense_keys[key], asc, ascq, info);
+		else
+			snprintf(msg, msglen, "sense key %s, asc/ascq %02x/%02x",
+				 sense_keys[key], asc, ascq);
+		/* Data has been read fine after all */
+		if (key == 1)
+			return sz - hdr.resid;
+		/* The buffer contents are undefined now, even before the
+		 * failing block; the retry with hardbs reads the good ones */
+		errno = (key == 5? EINVAL: EIO);
+		return -1;
+	}
+	snprintf(msg, msglen, "status %02x, host %02x, driver %02x",
+		 hdr.status, hdr.host_status, hdr.driver_status);
+	errno = EIO;
+	return -1;
+}
+
+#endif	/* HAVE_SCSI_SG_H */
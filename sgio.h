@@ -0,0 +1,40 @@
+/** sgio.h
+ *
+ * SCSI passthrough reads (SG_IO ioctl, READ(16)) for dd_rescue,
+ * bypassing the retries of the block layer and with a bounded
+ * command timeout.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#ifndef _SGIO_H
+#define _SGIO_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define _GNU_SOURCE 1
+#include <sys/types.h>
+
+#ifdef HAVE_SCSI_SG_H
+
+typedef struct _sgdev {
+	unsigned int lbsz;	/* logical block size, 0 = SG_IO not used */
+	unsigned int maxbytes;	/* max transfer per command */
+	loff_t cap;		/* capacity in bytes */
+} sgdev_t;
+
+/* Check whether fd talks SCSI and get block size and capacity;
+ * returns 0 or -errno (-EXDEV for a partition, not the whole disk) */
+int sgio_probe(int fd, sgdev_t *sg);
+/* Read sz bytes at off (both multiples of lbsz, sz <= maxbytes) with
+ * READ(16) and timeout tmo ms. Returns the number of bytes read (less
+ * than sz at the end of the device) or -1 with errno set (ETIME for
+ * timeouts); on a medium error, none of the buffer can be trusted.
+ * If there was sense data, a description is left in msg. */
+ssize_t sgio_pread(int fd, const sgdev_t *sg, void *buf, size_t sz, loff_t off,
+		   unsigned int tmo, char *msg, size_t msglen);
+
+#endif	/* HAVE_SCSI_SG_H */
+#endif	/* _SGIO_H */
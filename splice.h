@@ -26,6 +26,12 @@ static inline ssize_t splice(int fdin, off64_t *off_in, int fdout,
 {
 	return syscall(__NR_splice, fdin, off_in, fdout, off_out, len, flags);
 }
+#  ifdef __NR_tee
+static inline ssize_t tee(int fdin, int fdout, size_t len, unsigned int flags)
+{
+	return syscall(__NR_tee, fdin, fdout, len, flags);
+}
+#  endif
 # else
 _syscall6(long, splice, int, fdin, loff_t*, off_in, int, fdout, loff_t*, off_out, size_t, len, unsigned int, flags);
 # endif
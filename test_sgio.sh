@@ -0,0 +1,43 @@
+#!/bin/bash
+# test_sgio.sh
+#
+# Tests SG_IO reads (-7) against a scsi_debug device with
+# injected medium errors; needs root and the scsi_debug module
+#
+
+BAD=4660
+NBAD=10
+
+if test "$(id -u)" != 0 || ! modprobe scsi_debug dev_size_mb=8 opts=2 medium_error_start=$BAD medium_error_count=$NBAD; then
+	echo "INFO: No scsi_debug device available, skipping SG_IO test"
+	exit 0
+fi
+
+my_exit()
+{
+	echo "ERROR $1: $2" 1>&2
+	rm -f sgio.src sgio.out sgio.bb
+	rmmod scsi_debug
+	exit $1
+}
+
+DEV=""
+for i in $(seq 1 50); do
+	DEV=$(ls /sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*:*/block/ 2>/dev/null | head -n1)
+	if test -n "$DEV" -a -b /dev/$DEV; then break; fi
+	sleep 0.1
+done
+if test -z "$DEV"; then my_exit 1 "scsi_debug disk did not show up"; fi
+DEV=/dev/$DEV
+
+./dd_rescue -qt -Z 0 -m 8M sgio.src || my_exit 2 "Creating test data"
+./dd_rescue -q -n sgio.src $DEV || my_exit 3 "Writing test data"
+rm -f sgio.bb
+echo ./dd_rescue -t -7 2 -B 512 -b 64k -o sgio.bb $DEV sgio.out
+./dd_rescue -t -7 2 -B 512 -b 64k -o sgio.bb $DEV sgio.out
+# All bad sectors and only those should be reported
+test "$(cat sgio.bb | tr '\n' ' ')" = "$(seq -s ' ' $BAD $((BAD+NBAD-1))) " || my_exit 4 "Bad block list"
+cmp -n $((BAD*512)) sgio.src sgio.out || my_exit 5 "Compare before bad sectors"
+cmp -i $(((BAD+NBAD)*512)) sgio.src sgio.out || my_exit 6 "Compare after bad sectors"
+rm -f sgio.src sgio.out sgio.bb
+rmmod scsi_debug
@@ -0,0 +1,155 @@
+/** uring.c
+ *
+ * Minimal io_uring wrapper for dd_rescue: sets up one ring
+ * and allows to queue reads/writes and reap completions.
+ * Talks to the kernel via the raw syscalls, so we don't
+ * need liburing.
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if !defined(__NR_io_uring_setup) && defined(__linux__)
+# define __NR_io_uring_setup 425
+# define __NR_io_uring_enter 426
+#endif
+
+static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit,
+				     unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+#define PTR(base, off) ((void*)((char*)(base)+(off)))
+
+int uring_init(uring_t *ur, unsigned int entries)
+{
+	struct io_uring_params p;
+	memset(ur, 0, sizeof(*ur));
+	memset(&p, 0, sizeof(p));
+	ur->fd = sys_io_uring_setup(entries, &p);
+	if (ur->fd < 0)
+		return -errno;
+	ur->sq_entries = p.sq_entries;
+	ur->cq_entries = p.cq_entries;
+	ur->sq_sz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	ur->cq_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ur->cq_sz > ur->sq_sz)
+			ur->sq_sz = ur->cq_sz;
+		ur->cq_sz = ur->sq_sz;
+	}
+	ur->sq_ptr = mmap(0, ur->sq_sz, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+	if (ur->sq_ptr == MAP_FAILED)
+		goto err_close;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ur->cq_ptr = ur->sq_ptr;
+	else {
+		ur->cq_ptr = mmap(0, ur->cq_sz, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_CQ_RING);
+		if (ur->cq_ptr == MAP_FAILED)
+			goto err_unmap_sq;
+	}
+	ur->sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+	ur->sqes = (struct io_uring_sqe*)mmap(0, ur->sqes_sz, PROT_READ | PROT_WRITE,
+					      MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+	if (ur->sqes == MAP_FAILED)
+		goto err_unmap_cq;
+	ur->sq_head  = (unsigned*)PTR(ur->sq_ptr, p.sq_off.head);
+	ur->sq_tail  = (unsigned*)PTR(ur->sq_ptr, p.sq_off.tail);
+	ur->sq_mask  = (unsigned*)PTR(ur->sq_ptr, p.sq_off.ring_mask);
+	ur->sq_array = (unsigned*)PTR(ur->sq_ptr, p.sq_off.array);
+	ur->cq_head  = (unsigned*)PTR(ur->cq_ptr, p.cq_off.head);
+	ur->cq_tail  = (unsigned*)PTR(ur->cq_ptr, p.cq_off.tail);
+	ur->cq_mask  = (unsigned*)PTR(ur->cq_ptr, p.cq_off.ring_mask);
+	ur->cqes = (struct io_uring_cqe*)PTR(ur->cq_ptr, p.cq_off.cqes);
+	return 0;
+
+err_unmap_cq:
+	if (ur->cq_ptr != ur->sq_ptr)
+		munmap(ur->cq_ptr, ur->cq_sz);
+err_unmap_sq:
+	munmap(ur->sq_ptr, ur->sq_sz);
+err_close:
+	{
+		int err = errno;
+		close(ur->fd);
+		ur->fd = -1;
+		return -err;
+	}
+}
+
+void uring_exit(uring_t *ur)
+{
+	if (ur->fd < 0)
+		return;
+	munmap(ur->sqes, ur->sqes_sz);
+	if (ur->cq_ptr != ur->sq_ptr)
+		munmap(ur->cq_ptr, ur->cq_sz);
+	munmap(ur->sq_ptr, ur->sq_sz);
+	close(ur->fd);
+	ur->fd = -1;
+}
+
+int uring_prep_rw(uring_t *ur, int opcode, int fd, void *buf,
+		  unsigned int len, loff_t off, uint64_t udata)
+{
+	const unsigned tail = *ur->sq_tail;
+	const unsigned head = __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= ur->sq_entries)
+		return -EBUSY;
+	const unsigned idx = tail & *ur->sq_mask;
+	struct io_uring_sqe *sqe = ur->sqes + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = udata;
+	ur->sq_array[idx] = idx;
+	__atomic_store_n(ur->sq_tail, tail+1, __ATOMIC_RELEASE);
+	++ur->to_submit;
+	return 0;
+}
+
+int uring_submit(uring_t *ur, unsigned int wait_nr)
+{
+	int rc;
+	do {
+		rc = sys_io_uring_enter(ur->fd, ur->to_submit, wait_nr,
+					wait_nr? IORING_ENTER_GETEVENTS: 0);
+	} while (rc < 0 && errno == EINTR && !wait_nr);
+	if (rc < 0)
+		return -errno;
+	ur->to_submit -= rc;
+	return rc;
+}
+
+int uring_get_cqe(uring_t *ur, uint64_t *udata, int *res)
+{
+	const unsigned head = *ur->cq_head;
+	if (head == __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	const struct io_uring_cqe *cqe = ur->cqes + (head & *ur->cq_mask);
+	*udata = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ur->cq_head, head+1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+#endif	/* HAVE_LINUX_IO_URING_H */
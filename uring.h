@@ -0,0 +1,52 @@
+/** uring.h
+ *
+ * Minimal io_uring wrapper for dd_rescue, using the raw
+ * syscalls (no dependency on liburing).
+ *
+ * License: GNU GPL v2 or v3
+ */
+
+#ifndef _URING_H
+#define _URING_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#define _GNU_SOURCE 1
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+
+typedef struct _uring {
+	int fd;
+	unsigned int sq_entries, cq_entries;
+	/* Submission queue (shared with kernel) */
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	/* Completion queue (shared with kernel) */
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	/* mappings */
+	void *sq_ptr, *cq_ptr;
+	size_t sq_sz, cq_sz, sqes_sz;
+	/* prepared, but not yet submitted */
+	unsigned int to_submit;
+} uring_t;
+
+/* Set up a ring with (at least) entries slots; returns 0 or -errno */
+int uring_init(uring_t *ur, unsigned int entries);
+void uring_exit(uring_t *ur);
+/* Queue a read (IORING_OP_READ) or write (IORING_OP_WRITE);
+ * returns 0 or -EBUSY if the submission queue is full */
+int uring_prep_rw(uring_t *ur, int opcode, int fd, void *buf,
+		  unsigned int len, loff_t off, uint64_t udata);
+/* Submit queued requests and wait for at least wait_nr completions */
+int uring_submit(uring_t *ur, unsigned int wait_nr);
+/* Fetch one completion; returns 1 if one was available, 0 otherwise */
+int uring_get_cqe(uring_t *ur, uint64_t *udata, int *res);
+
+#endif	/* HAVE_LINUX_IO_URING_H */
+#endif	/* _URING_H */